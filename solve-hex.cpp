@@ -18,7 +18,15 @@
 
   Compile with
 
-  g++ -std=c++17 -O3 -march=native -o solve-hex solve-hex.cpp
+  g++ -std=c++17 -O3 -march=native -pthread -o solve-hex solve-hex.cpp
+
+  For a profile-guided build, compile with "-fprofile-generate" added,
+  train it on the strategies of interest, for example
+
+  ./solve-hex bench deduce-array-swap deduce-array-swap-unrolled
+
+  and then recompile with "-fprofile-use -fprofile-partial-training" in
+  place of "-fprofile-generate".
 
   And then run with no command-line arguments to see the different solution
   strategies which can be attempted.  Very slow strategies are halted after
@@ -26,22 +34,54 @@
   See code below for details.
 */
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 static const size_t N_Hexes = 19;
 static const uint8_t Required_Sum = 38;
 
 using VecUInt8 = std::vector<uint8_t>;
-using ConsumeVecFun = std::function<void(const VecUInt8 &)>;
-
 using ArrUInt8 = std::array<uint8_t, N_Hexes>;
-using ConsumeArrFun = std::function<void(const ArrUInt8 &)>;
 
 /*
   Raster order:
@@ -61,481 +101,3718 @@ using ConsumeArrFun = std::function<void(const ArrUInt8 &)>;
           8     7     6
 */
 
-template<typename NumbersT, typename... Ts>
+template<int Sum = Required_Sum, typename NumbersT, typename... Ts>
 inline bool sum_correct(const NumbersT & board, Ts... idxs)
 {
-  return (board[idxs] + ...) == Required_Sum;
+  return (board[idxs] + ...) == Sum;
 }
 
 static size_t n_attempts = 0;
 static size_t n_attempts_log_period = 10000000;
 static size_t n_attempts_bail = 100000000;
 
-struct CheckHardcoded
+// Each strategy which counts attempts sets its own limits before it
+// starts, so that they do not carry over from one strategy to the next
+// when "batch" or "bench" runs several in the same process.
+void set_attempt_limits(size_t log_period, size_t bail)
 {
-  template<typename NumbersT>
-  static bool is_solution(const NumbersT & board)
-  {
-    ++n_attempts;
+  n_attempts_log_period = log_period;
+  n_attempts_bail = bail;
+}
 
-    if (n_attempts % n_attempts_log_period == 0) {
-      std::cout << n_attempts << " attempts\n";
-    }
+// Attempts made by earlier runs of a resumed search.
+static size_t n_attempts_bail_offset = 0;
 
-    if (n_attempts == n_attempts_bail) {
-      std::cout << "stopping\n";
-      std::exit(0);
-    }
+// Thrown on reaching "n_attempts_bail", so the search unwinds back to
+// its caller rather than the whole process exiting.
+struct SearchBailed {};
 
-    return (sum_correct(board, 0, 1, 2)
-            && sum_correct(board, 3, 4, 5, 6)
-            && sum_correct(board, 7, 8, 9, 10, 11)
-            && sum_correct(board, 12, 13, 14, 15)
-            && sum_correct(board, 16, 17, 18)
-            && sum_correct(board, 0, 3, 7)
-            && sum_correct(board, 1, 4, 8, 12)
-            && sum_correct(board, 2, 5, 9, 13, 16)
-            && sum_correct(board, 6, 10, 14, 17)
-            && sum_correct(board, 11, 15, 18)
-            && sum_correct(board, 2, 6, 11)
-            && sum_correct(board, 1, 5, 10, 15)
-            && sum_correct(board, 0, 4, 9, 14, 18)
-            && sum_correct(board, 3, 8, 13, 17)
-            && sum_correct(board, 7, 12, 16));
-  }
-};
+// Thrown by a sink once it has all the solutions it wants, so the
+// search unwinds straight away.
+struct SearchStopped {};
 
-bool spiral_solution_is_correct(const ArrUInt8 & board)
+// Set when the last reported search was stopped that way, rather than
+// running to the end.
+static bool search_stopped_early = false;
+
+// How many extra, silent, runs the quick strategies do for timing.
+static size_t n_quiet_repeats = 99;
+
+/*
+  Checkpointing for the slow strategies.  Their available values are
+  always kept in increasing order, so the board being tried determines
+  which value was chosen at every depth, and it serves as the whole
+  search cursor.  With a checkpoint file set, the board being tried and
+  the attempt count so far are saved every "checkpoint_period_seconds"
+  (checking the clock only every few million positions), when bailing
+  out, when stopping on the last solution wanted, and, marked finished,
+  once the search completes.  Resuming reloads them into "resume_board"
+  and "n_attempts", and the search skips forward to that board before
+  carrying on as normal; a board saved on stopping was already
+  reported, so it goes in "skip_solution" to be passed over once.  Each
+  run, resumed or not, makes up to the usual number of attempts before
+  bailing, so repeated runs sweep consecutive stretches.
+
+  The file is: "HEXCKPT1"; the strategy name's length (uint32) and
+  characters; the CheckpointState (uint8); n_attempts (uint64); the
+  board's length (uint8) and values (uint8 each).  Integers are in
+  native byte order.
+*/
+static std::string checkpoint_path;
+static double checkpoint_period_seconds = 60.0;
+static std::string checkpoint_strategy;
+static VecUInt8 resume_board;
+static VecUInt8 skip_solution;
+// The attempts made before the position last noted, which is where a
+// resumed search counts from when it tries that position again.
+static uint64_t n_attempts_before_position = 0;
+
+enum class CheckpointState : uint8_t
 {
-  return (sum_correct(board, 0, 1, 2)
-          && sum_correct(board, 11, 12, 13, 3)
-          && sum_correct(board, 10, 17, 18, 14, 4)
-          && sum_correct(board, 9, 16, 15, 5)
-          && sum_correct(board, 8, 7, 6)
-          && sum_correct(board, 0, 11, 10)
-          && sum_correct(board, 1, 12, 17, 9)
-          && sum_correct(board, 2, 13, 18, 16, 8)
-          && sum_correct(board, 3, 14, 15, 7)
-          && sum_correct(board, 4, 5, 6)
-          && sum_correct(board, 2, 3, 4)
-          && sum_correct(board, 1, 13, 14, 5)
-          && sum_correct(board, 0, 12, 18, 15, 6)
-          && sum_correct(board, 11, 17, 16, 7)
-          && sum_correct(board, 10, 9, 8));
-}
-
-static const std::vector<std::vector<size_t>> hex_lines = {
-  {0, 1, 2},
-  {3, 4, 5, 6},
-  {7, 8, 9, 10, 11},
-  {12, 13, 14, 15},
-  {16, 17, 18},
-  {0, 3, 7},
-  {1, 4, 8, 12},
-  {2, 5, 9, 13, 16},
-  {6, 10, 14, 17},
-  {11, 15, 18},
-  {2, 6, 11},
-  {1, 5, 10, 15},
-  {0, 4, 9, 14, 18},
-  {3, 8, 13, 17},
-  {7, 12, 16},
+  InProgress,
+  Finished,
+  StoppedAtSolution,
 };
 
-struct CheckVecOfVecs
+static const char Checkpoint_Magic[8] = {'H', 'E', 'X', 'C', 'K', 'P', 'T', '1'};
+static const size_t Checkpoint_Clock_Period = 1 << 22;
+static size_t n_positions_since_clock_check = 0;
+static std::chrono::steady_clock::time_point last_checkpoint_time;
+
+template<typename T>
+void write_binary(std::ostream & out, const T & value)
 {
-  static bool is_solution(const VecUInt8 & soln)
-  {
-    ++n_attempts;
+  out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
 
-    if (n_attempts % n_attempts_log_period == 0) {
-      std::cout << n_attempts << " attempts\n";
-    }
+template<typename T>
+bool read_binary(std::istream & in, T & value)
+{
+  return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
 
-    if (n_attempts == n_attempts_bail) {
-      std::cout << "stopping\n";
-      std::exit(0);
-    }
+template<typename NumbersT>
+void save_checkpoint(const NumbersT & board, uint64_t n_attempts_done,
+                     CheckpointState state = CheckpointState::InProgress)
+{
+  // Solutions found before the checkpoint must not be lost with the
+  // output buffer if the process is then killed.
+  std::cout.flush();
 
-    for (const auto & line : hex_lines) {
-      int sum = 0;
-      for (const auto idx : line)
-        sum += soln[idx];
-      if (sum != Required_Sum)
-        return false;
+  const std::string tmp_path = checkpoint_path + ".tmp";
+  {
+    std::ofstream out{tmp_path, std::ios::binary};
+    out.write(Checkpoint_Magic, sizeof(Checkpoint_Magic));
+    write_binary(out, static_cast<uint32_t>(checkpoint_strategy.size()));
+    out.write(checkpoint_strategy.data(), checkpoint_strategy.size());
+    write_binary(out, state);
+    write_binary(out, n_attempts_done);
+    write_binary(out, static_cast<uint8_t>(board.size()));
+    for (const uint8_t n : board)
+      write_binary(out, n);
+    if (!out) {
+      std::cerr << "Could not write checkpoint " << tmp_path << "\n";
+      return;
     }
-
-    return true;
   }
-};
-
-enum class FillOrder { Raster, Spiral };
+  std::rename(tmp_path.c_str(), checkpoint_path.c_str());
+  last_checkpoint_time = std::chrono::steady_clock::now();
+}
 
-struct BoardState
+/*
+  Load the checkpoint, if there is one, returning false if it is
+  unreadable or for another strategy.  "finished" says whether it
+  records a completed search.
+*/
+bool load_checkpoint(bool & finished)
 {
-  VecUInt8 board;
-  VecUInt8 available;
-  ConsumeVecFun consume_fun;
+  finished = false;
+  std::ifstream in{checkpoint_path, std::ios::binary};
+  if (!in)
+    return true;
 
-  BoardState(ConsumeVecFun consume_fun)
-    : available(N_Hexes)
-    , consume_fun(consume_fun)
-  {
-    std::iota(available.begin(), available.end(), 1);
-  }
+  char magic[sizeof(Checkpoint_Magic)];
+  uint32_t name_length = 0;
+  CheckpointState state = CheckpointState::InProgress;
+  uint64_t n_attempts_done = 0;
+  uint8_t n_cells = 0;
+  bool ok = (in.read(magic, sizeof(magic))
+             && std::equal(magic, magic + sizeof(magic), Checkpoint_Magic)
+             && read_binary(in, name_length)
+             && name_length < 256);
+  std::string name(ok ? name_length : 0, ' ');
+  ok = (ok
+        && in.read(&name[0], name_length)
+        && read_binary(in, state)
+        && state <= CheckpointState::StoppedAtSolution
+        && read_binary(in, n_attempts_done)
+        && read_binary(in, n_cells)
+        && n_cells <= N_Hexes);
+  VecUInt8 board(ok ? n_cells : 0);
+  for (auto & n : board)
+    ok = ok && read_binary(in, n);
 
-  BoardState(const BoardState & rhs)
-    : board(rhs.board)
-    , available(rhs.available)
-    , consume_fun(rhs.consume_fun)
-  {
+  if (!ok) {
+    std::cerr << "Checkpoint " << checkpoint_path << " is not valid\n";
+    return false;
   }
-
-  template<typename Check>
-  void solve_check_when_full()
-  {
-    if (available.size() == 0
-        && Check::is_solution(board)) {
-      consume_fun(board);
-    }
-    else {
-      const auto n_available = available.size();
-      for (size_t idx = 0; idx != n_available; ++idx) {
-        auto new_board_state = BoardState{*this};
-        new_board_state.board.push_back(available[idx]);
-        new_board_state.available.erase(
-          new_board_state.available.begin() + idx
-        );
-        new_board_state.solve_check_when_full<Check>();
-      }
-    }
+  if (name != checkpoint_strategy) {
+    std::cerr << "Checkpoint " << checkpoint_path << " is for \"" << name
+              << "\", not \"" << checkpoint_strategy << "\"\n";
+    return false;
   }
 
-  template<FillOrder FO>
-  bool incorrect_already();
+  finished = (state == CheckpointState::Finished);
+  resume_board = board;
+  if (state == CheckpointState::StoppedAtSolution)
+    skip_solution = board;
+  n_attempts = n_attempts_done;
+  return true;
+}
 
-  template<FillOrder FO>
-  void solve_test_as_lines_filled()
-  {
-    if (incorrect_already<FO>())
-      return;
+// Called with each position the search reaches, before trying it.
+template<typename NumbersT>
+inline void note_search_position(const NumbersT & board, uint64_t n_attempts_done)
+{
+  if (checkpoint_path.empty())
+    return;
+  n_attempts_before_position = n_attempts_done;
+  if (++n_positions_since_clock_check != Checkpoint_Clock_Period)
+    return;
 
-    const auto n_available = available.size();
-    if (n_available == 0) {
-      consume_fun(board);
-      return;
-    }
+  n_positions_since_clock_check = 0;
+  const std::chrono::duration<double> since_checkpoint
+    = std::chrono::steady_clock::now() - last_checkpoint_time;
+  if (since_checkpoint.count() >= checkpoint_period_seconds)
+    save_checkpoint(board, n_attempts_done);
+}
 
-    for (size_t idx = 0; idx != n_available; ++idx) {
-      auto new_board_state = BoardState{*this};
-      new_board_state.board.push_back(available[idx]);
-      new_board_state.available.erase(new_board_state.available.begin() + idx);
-      new_board_state.solve_test_as_lines_filled<FO>();
-    }
-  }
+template<typename NumbersT>
+[[noreturn]] void bail_out(const NumbersT & board)
+{
+  if (!checkpoint_path.empty())
+    save_checkpoint(board, n_attempts - 1);
+  std::cout << "stopping\n";
+  throw SearchBailed{};
+}
 
-  void move_to_board(size_t available_idx)
-  {
-    board.push_back(available[available_idx]);
-    available.erase(available.begin() + available_idx);
-  }
+/*
+  Count an attempt at "board", for the strategies which try complete
+  boards one at a time, logging progress periodically and bailing out,
+  after calling "before_bail", once the limit is reached.  Only the
+  strategies which support checkpoints note the search position, as
+  even the check for a checkpoint file shows up in the others' loops.
+*/
+struct NothingBeforeBail { void operator()() const {} };
 
-  void choose()
-  {
-    for (size_t i = 0; i != available.size(); ++i) {
-      BoardState new_state{*this};
-      new_state.move_to_board(i);
-      new_state.solve_deduce_last_cell_of_line();
-    }
-  }
+template<bool NotePosition = true, typename NumbersT, typename BeforeBail = NothingBeforeBail>
+inline void count_attempt(const NumbersT & board, BeforeBail before_bail = BeforeBail{})
+{
+  ++n_attempts;
+  if constexpr (NotePosition)
+    note_search_position(board, n_attempts - 1);
 
-  template<typename... Ts>
-  void deduce(Ts... have_idxs)
-  {
-    uint8_t needed = Required_Sum - (board[have_idxs] + ...);
-    auto maybe_found = std::find(available.begin(), available.end(), needed);
-    if (maybe_found != available.end()) {
-      size_t needed_idx = maybe_found - available.begin();
+  if (n_attempts % n_attempts_log_period == 0) {
+    std::cout << n_attempts << " attempts\n";
+  }
 
-      BoardState new_state{*this};
-      new_state.move_to_board(needed_idx);
-      new_state.solve_deduce_last_cell_of_line();
-    }
+  if (n_attempts == n_attempts_bail_offset + n_attempts_bail) {
+    before_bail();
+    bail_out(board);
   }
+}
+
+template<typename NumbersT>
+bool raster_solution_is_correct(const NumbersT & board)
+{
+  return (sum_correct(board, 0, 1, 2)
+          && sum_correct(board, 3, 4, 5, 6)
+          && sum_correct(board, 7, 8, 9, 10, 11)
+          && sum_correct(board, 12, 13, 14, 15)
+          && sum_correct(board, 16, 17, 18)
+          && sum_correct(board, 0, 3, 7)
+          && sum_correct(board, 1, 4, 8, 12)
+          && sum_correct(board, 2, 5, 9, 13, 16)
+          && sum_correct(board, 6, 10, 14, 17)
+          && sum_correct(board, 11, 15, 18)
+          && sum_correct(board, 2, 6, 11)
+          && sum_correct(board, 1, 5, 10, 15)
+          && sum_correct(board, 0, 4, 9, 14, 18)
+          && sum_correct(board, 3, 8, 13, 17)
+          && sum_correct(board, 7, 12, 16));
+}
 
-  void solve_deduce_last_cell_of_line()
+struct CheckHardcoded
+{
+  template<typename NumbersT>
+  static bool is_solution(const NumbersT & board)
   {
-    switch (board.size()) {
-    case 0: case 1: case 3: case 5: case 7: case 9: case 12: choose(); break;
-    case 2: deduce(0, 1); break;
-    case 4: deduce(2, 3); break;
-    case 6: deduce(4, 5); break;
-    case 8: deduce(7, 6); break;
-    case 10: deduce(8, 9); break;
-    case 11: deduce(0, 10); break;
-    case 13: deduce(3, 11, 12); break;
-    case 14: deduce(1, 5, 13); break;
-    case 15: deduce(3, 7, 14); break;
-    case 16: deduce(5, 9, 15); break;
-    case 17: deduce(7, 11, 16); break;
-    case 18: deduce(4, 10, 14, 17); break;
-    case 19:
-      if (CheckHardcoded::is_solution(board))
-        consume_fun(board);
-      break;
-    }
+    count_attempt(board);
+    return raster_solution_is_correct(board);
   }
 };
 
-template<>
-bool BoardState::incorrect_already<FillOrder::Raster>()
+template<int Sum = Required_Sum, typename NumbersT>
+bool spiral_solution_is_correct(const NumbersT & board)
 {
-  const size_t n_filled = board.size();
-  return ((n_filled == 3 && !sum_correct(board, 0, 1, 2))
-          || (n_filled == 7 && !sum_correct(board, 3, 4, 5, 6))
-          || (n_filled == 8 && !sum_correct(board, 0, 3, 7))
-          || (n_filled == 12 && !sum_correct(board, 7, 8, 9, 10, 11))
-          || (n_filled == 12 && !sum_correct(board, 2, 6, 11))
-          || (n_filled == 13 && !sum_correct(board, 1, 4, 8, 12))
-          || (n_filled == 16 && !sum_correct(board, 12, 13, 14, 15))
-          || (n_filled == 16 && !sum_correct(board, 1, 5, 10, 15))
-          || (n_filled == 17 && !sum_correct(board, 7, 12, 16))
-          || (n_filled == 17 && !sum_correct(board, 2, 5, 9, 13, 16))
-          || (n_filled == 18 && !sum_correct(board, 3, 8, 13, 17))
-          || (n_filled == 18 && !sum_correct(board, 6, 10, 14, 17))
-          || (n_filled == 19 && !sum_correct(board, 0, 4, 9, 14, 18))
-          || (n_filled == 19 && !sum_correct(board, 11, 15, 18))
-          || (n_filled == 19 && !sum_correct(board, 16, 17, 18)));
+  return (sum_correct<Sum>(board, 0, 1, 2)
+          && sum_correct<Sum>(board, 11, 12, 13, 3)
+          && sum_correct<Sum>(board, 10, 17, 18, 14, 4)
+          && sum_correct<Sum>(board, 9, 16, 15, 5)
+          && sum_correct<Sum>(board, 8, 7, 6)
+          && sum_correct<Sum>(board, 0, 11, 10)
+          && sum_correct<Sum>(board, 1, 12, 17, 9)
+          && sum_correct<Sum>(board, 2, 13, 18, 16, 8)
+          && sum_correct<Sum>(board, 3, 14, 15, 7)
+          && sum_correct<Sum>(board, 4, 5, 6)
+          && sum_correct<Sum>(board, 2, 3, 4)
+          && sum_correct<Sum>(board, 1, 13, 14, 5)
+          && sum_correct<Sum>(board, 0, 12, 18, 15, 6)
+          && sum_correct<Sum>(board, 11, 17, 16, 7)
+          && sum_correct<Sum>(board, 10, 9, 8));
 }
 
-template<>
-bool BoardState::incorrect_already<FillOrder::Spiral>()
+static constexpr size_t N_Lines = 15;
+static constexpr size_t Max_Line_Length = 5;
+
+struct HexLine
 {
-  const size_t n_filled = board.size();
-  return ((n_filled == 3 && !sum_correct(board, 0, 1, 2))
-          || (n_filled == 5 && !sum_correct(board, 2, 3, 4))
-          || (n_filled == 7 && !sum_correct(board, 4, 5, 6))
-          || (n_filled == 9 && !sum_correct(board, 6, 7, 8))
-          || (n_filled == 11 && !sum_correct(board, 8, 9, 10))
-          || (n_filled == 12 && !sum_correct(board, 0, 10, 11))
-          || (n_filled == 14 && !sum_correct(board, 3, 11, 12, 13))
-          || (n_filled == 15 && !sum_correct(board, 1, 13, 14, 5))
-          || (n_filled == 16 && !sum_correct(board, 3, 14, 15, 7))
-          || (n_filled == 17 && !sum_correct(board, 5, 15, 16, 9))
-          || (n_filled == 18 && !sum_correct(board, 7, 16, 17, 11))
-          || (n_filled == 18 && !sum_correct(board, 1, 12, 17, 9))
-          || (n_filled == 19 && !sum_correct(board, 0, 12, 18, 15, 6))
-          || (n_filled == 19 && !sum_correct(board, 2, 13, 18, 16, 8))
-          || (n_filled == 19 && !sum_correct(board, 4, 14, 18, 17, 10)));
-}
+  size_t n_cells;
+  size_t cells[Max_Line_Length];
+};
+
+static constexpr HexLine hex_line_table[N_Lines] = {
+  {3, {0, 1, 2}},
+  {4, {3, 4, 5, 6}},
+  {5, {7, 8, 9, 10, 11}},
+  {4, {12, 13, 14, 15}},
+  {3, {16, 17, 18}},
+  {3, {0, 3, 7}},
+  {4, {1, 4, 8, 12}},
+  {5, {2, 5, 9, 13, 16}},
+  {4, {6, 10, 14, 17}},
+  {3, {11, 15, 18}},
+  {3, {2, 6, 11}},
+  {4, {1, 5, 10, 15}},
+  {5, {0, 4, 9, 14, 18}},
+  {4, {3, 8, 13, 17}},
+  {3, {7, 12, 16}},
+};
+
+static const std::vector<std::vector<size_t>> hex_lines = [] {
+  std::vector<std::vector<size_t>> lines;
+  for (const auto & line : hex_line_table)
+    lines.emplace_back(line.cells, line.cells + line.n_cells);
+  return lines;
+}();
 
-enum struct RecursionStrategy { CreateNew, SwapAndSwapBack };
+// Raster index of the cell at each position of the inwards spiral.
+static constexpr size_t spiral_to_raster[N_Hexes] = {
+  0, 1, 2, 6, 11, 15, 18, 17, 16, 12, 7, 3, 4, 5, 10, 14, 13, 8, 9
+};
 
-struct ArrayBoardState
+/*
+  Compile-time schedule for filling the board in spiral order.  At
+  each depth (number of cells already filled) the next cell is either
+  chosen freely or, if it is the last cell of some line, deduced from
+  the other cells of that line.  If it completes more than one line,
+  the first one in "hex_line_table" is used, and "line_idx" says which
+  it is; the final check of all lines catches any others.  Indices in
+  "have_idxs" are spiral positions.
+*/
+struct ScheduleStep
 {
-  ArrUInt8 numbers;
-  size_t n_cells_filled;
-  ConsumeArrFun consume_fun;
+  bool is_choice;
+  size_t n_have;
+  size_t have_idxs[Max_Line_Length - 1];
+  size_t line_idx;
+};
 
-  ArrayBoardState(ConsumeArrFun consume_fun)
-    : n_cells_filled(0)
-    , consume_fun(consume_fun)
-  {
-    std::iota(numbers.begin(), numbers.end(), 1);
-  }
+using Schedule = std::array<ScheduleStep, N_Hexes>;
 
-  ArrayBoardState(const ArrayBoardState & other)
-    : numbers(other.numbers)
-    , n_cells_filled(other.n_cells_filled)
-    , consume_fun(other.consume_fun)
-  {
+constexpr Schedule make_schedule(const size_t (& fill_order)[N_Hexes])
+{
+  Schedule schedule{};
+  size_t position_of_cell[N_Hexes]{};
+  for (size_t pos = 0; pos != N_Hexes; ++pos) {
+    position_of_cell[fill_order[pos]] = pos;
+    schedule[pos].is_choice = true;
   }
 
-  size_t find_needed(uint8_t needed_value)
-  {
-    for (size_t i = n_cells_filled; i != N_Hexes; ++i) {
-      if (numbers[i] == needed_value) {
-        return i;
+  for (size_t line_idx = 0; line_idx != N_Lines; ++line_idx) {
+    const auto & line = hex_line_table[line_idx];
+    size_t last_pos = 0;
+    for (size_t i = 0; i != line.n_cells; ++i)
+      last_pos = std::max(last_pos, position_of_cell[line.cells[i]]);
+
+    auto & step = schedule[last_pos];
+    if (step.is_choice) {
+      step.is_choice = false;
+      step.line_idx = line_idx;
+      for (size_t i = 0; i != line.n_cells; ++i) {
+        const size_t pos = position_of_cell[line.cells[i]];
+        if (pos != last_pos)
+          step.have_idxs[step.n_have++] = pos;
       }
     }
-    return N_Hexes;
   }
 
-  template<RecursionStrategy RS>
-  void choose();
+  return schedule;
+}
 
-  template<typename... Ts>
-  size_t find_needed_from_idxs(Ts... have_idxs)
-  {
-    uint8_t needed = Required_Sum - (numbers[have_idxs] + ...);
-    return find_needed(needed);
-  }
+static constexpr Schedule spiral_schedule = make_schedule(spiral_to_raster);
 
-  template<RecursionStrategy RS>
-  void deduce(size_t i1, size_t i2)
-  {
-    deduce_from_idx<RS>(find_needed_from_idxs(i1, i2));
-  }
+/*
+  For range pruning: at each depth, the lines through the cell just
+  filled which still have unfilled cells, with the positions of their
+  filled cells and how many are left.  Each cell is on three lines.
+*/
+struct PartialLine
+{
+  size_t n_filled;
+  size_t filled_idxs[Max_Line_Length];
+  size_t n_unfilled;
+};
 
-  template<RecursionStrategy RS>
-  void deduce(size_t i1, size_t i2, size_t i3)
-  {
-    deduce_from_idx<RS>(find_needed_from_idxs(i1, i2, i3));
-  }
+struct PartialLinesStep
+{
+  size_t n_lines;
+  PartialLine lines[3];
+};
 
-  template<RecursionStrategy RS>
-  void deduce(size_t i1, size_t i2, size_t i3, size_t i4)
-  {
-    deduce_from_idx<RS>(find_needed_from_idxs(i1, i2, i3, i4));
-  }
+using PartialLinesSchedule = std::array<PartialLinesStep, N_Hexes>;
 
-  template<RecursionStrategy RS>
-  void deduce_from_idx(size_t maybe_needed_idx);
+constexpr PartialLinesSchedule make_partial_lines_schedule(const size_t (& fill_order)[N_Hexes])
+{
+  PartialLinesSchedule schedule{};
+  size_t position_of_cell[N_Hexes]{};
+  for (size_t pos = 0; pos != N_Hexes; ++pos)
+    position_of_cell[fill_order[pos]] = pos;
 
-  template<RecursionStrategy RS>
-  void solve()
-  {
-    switch (n_cells_filled) {
-    case 0: case 1: case 3: case 5: case 7: case 9: case 12: choose<RS>(); break;
-    case 2: deduce<RS>(0, 1); break;
-    case 4: deduce<RS>(2, 3); break;
-    case 6: deduce<RS>(4, 5); break;
-    case 8: deduce<RS>(7, 6); break;
-    case 10: deduce<RS>(8, 9); break;
-    case 11: deduce<RS>(0, 10); break;
-    case 13: deduce<RS>(3, 11, 12); break;
-    case 14: deduce<RS>(1, 5, 13); break;
-    case 15: deduce<RS>(3, 7, 14); break;
-    case 16: deduce<RS>(5, 9, 15); break;
-    case 17: deduce<RS>(7, 11, 16); break;
-    case 18: deduce<RS>(4, 10, 14, 17); break;
-    case 19:
-      if (spiral_solution_is_correct(numbers))
-        consume_fun(numbers);
-      break;
+  for (const auto & line : hex_line_table) {
+    for (size_t i = 0; i != line.n_cells; ++i) {
+      const size_t depth = position_of_cell[line.cells[i]];
+      PartialLine partial{};
+      for (size_t j = 0; j != line.n_cells; ++j) {
+        const size_t pos = position_of_cell[line.cells[j]];
+        if (pos <= depth)
+          partial.filled_idxs[partial.n_filled++] = pos;
+        else
+          ++partial.n_unfilled;
+      }
+      if (partial.n_unfilled != 0) {
+        auto & step = schedule[depth];
+        step.lines[step.n_lines++] = partial;
+      }
     }
   }
-};
 
-template<>
-void ArrayBoardState::choose<RecursionStrategy::CreateNew>()
-{
-  ++n_cells_filled;
-  solve<RecursionStrategy::CreateNew>();
-  --n_cells_filled;
-  for (size_t i = n_cells_filled + 1; i != N_Hexes; ++i) {
-    ArrayBoardState swapped_state{*this};
-    std::swap(swapped_state.numbers[n_cells_filled], swapped_state.numbers[i]);
-    ++swapped_state.n_cells_filled;
-    swapped_state.solve<RecursionStrategy::CreateNew>();
-  }
+  return schedule;
 }
 
-template<>
-void ArrayBoardState::deduce_from_idx<RecursionStrategy::CreateNew>(
-  size_t maybe_needed_idx
-) {
-  if (maybe_needed_idx != N_Hexes) {
-    ArrayBoardState swapped_state{*this};
-    std::swap(swapped_state.numbers[n_cells_filled], swapped_state.numbers[maybe_needed_idx]);
-    ++swapped_state.n_cells_filled;
-    swapped_state.solve<RecursionStrategy::CreateNew>();
-  }
-}
+static constexpr PartialLinesSchedule spiral_partial_lines
+  = make_partial_lines_schedule(spiral_to_raster);
 
-template<>
-void ArrayBoardState::choose<RecursionStrategy::SwapAndSwapBack>()
-{
-  ++n_cells_filled;
-  solve<RecursionStrategy::SwapAndSwapBack>();
-  --n_cells_filled;
-  for (size_t i = n_cells_filled + 1; i != N_Hexes; ++i) {
-    std::swap(numbers[n_cells_filled], numbers[i]);
-    ++n_cells_filled;
-    solve<RecursionStrategy::SwapAndSwapBack>();
-    --n_cells_filled;
-    std::swap(numbers[n_cells_filled], numbers[i]);
-  }
-}
+/*
+  The twelve rotations and reflections of the board, as maps from
+  spiral position to spiral position.  Rotating by one sixth of a turn
+  moves each outer-ring cell two places along the spiral and each
+  inner-ring cell one place; reflecting in the line through corners 0
+  and 6 reverses both rings about those corners.  The centre is fixed.
+*/
+static constexpr size_t N_Symmetries = 12;
+static constexpr size_t N_Outer_Ring = 12;
+static constexpr size_t N_Inner_Ring = 6;
 
-template<>
-void ArrayBoardState::deduce_from_idx<RecursionStrategy::SwapAndSwapBack>(
-  size_t maybe_needed_idx
-) {
-  if (maybe_needed_idx != N_Hexes) {
-    std::swap(numbers[n_cells_filled], numbers[maybe_needed_idx]);
-    ++n_cells_filled;
-    solve<RecursionStrategy::SwapAndSwapBack>();
-    --n_cells_filled;
-    std::swap(numbers[n_cells_filled], numbers[maybe_needed_idx]);
-  }
-}
+using SpiralMap = std::array<size_t, N_Hexes>;
 
-template<typename T>
-void ignore(const T & /* board */)
+constexpr std::array<SpiralMap, N_Symmetries> make_spiral_symmetries()
 {
+  std::array<SpiralMap, N_Symmetries> symmetries{};
+  for (size_t sym = 0; sym != N_Symmetries; ++sym) {
+    const size_t rotation = sym % 6;
+    const bool reflect = (sym >= 6);
+    auto & map = symmetries[sym];
+    for (size_t i = 0; i != N_Outer_Ring; ++i) {
+      const size_t reflected = reflect ? (N_Outer_Ring - i) % N_Outer_Ring : i;
+      map[i] = (reflected + 2 * rotation) % N_Outer_Ring;
+    }
+    for (size_t j = 0; j != N_Inner_Ring; ++j) {
+      const size_t reflected = reflect ? (N_Inner_Ring - j) % N_Inner_Ring : j;
+      map[N_Outer_Ring + j] = N_Outer_Ring + (reflected + rotation) % N_Inner_Ring;
+    }
+    map[N_Hexes - 1] = N_Hexes - 1;
+  }
+  return symmetries;
 }
 
-template<typename T>
-void dump(const T & board)
+static constexpr auto spiral_symmetries = make_spiral_symmetries();
+
+/*
+  Canonical form under those symmetries: corner 0 holds the smallest of
+  the six corner values (spiral positions 0, 2, ..., 10), which picks
+  one rotation, and corner 2 is smaller than corner 10, which picks one
+  of the two reflections.  Each solution is the canonical form of
+  exactly one of its twelve images, since the corner values are
+  distinct.
+*/
+template<size_t Pos, typename NumbersT>
+constexpr bool corner_value_is_canonical(const NumbersT & numbers, uint8_t value)
 {
-  std::cout << "HEX:";
-  for (const uint8_t n : board)
-    std::cout << " " << static_cast<int>(n);
-  std::cout << "\n";
+  if constexpr (Pos != 0 && Pos < N_Outer_Ring && Pos % 2 == 0) {
+    if (value < numbers[0])
+      return false;
+    if constexpr (Pos == N_Outer_Ring - 2)
+      return value > numbers[2];
+  }
+  return true;
 }
 
-template<typename Check>
-void solve_manual_perm()
+template<typename NumbersT>
+NumbersT transformed_board(const NumbersT & board, const SpiralMap & map)
 {
-  BoardState{dump<VecUInt8>}.solve_check_when_full<Check>();
+  NumbersT image{board};
+  for (size_t i = 0; i != N_Hexes; ++i)
+    image[map[i]] = board[i];
+  return image;
 }
 
-template<typename Check>
-void solve_std_perm()
+struct CheckVecOfVecs
 {
-  n_attempts_log_period = 250000000;
-  n_attempts_bail = 2500000000;
+  template<typename NumbersT>
+  static bool is_solution(const NumbersT & soln)
+  {
+    count_attempt(soln);
 
-  VecUInt8 board(N_Hexes);
-  std::iota(board.begin(), board.end(), 1);
+    for (const auto & line : hex_lines) {
+      int sum = 0;
+      for (const auto idx : line)
+        sum += soln[idx];
+      if (sum != Required_Sum)
+        return false;
+    }
 
-  while (true) {
-    if (Check::is_solution(board))
-      dump(board);
-    if ( ! std::next_permutation(board.begin(), board.end()))
-      break;
+    return true;
   }
-}
+};
 
-template<FillOrder FO>
-void solve_test_line_by_line()
+/*
+  Check the line sums of a batch of complete raster-order boards at
+  once.  Boards are stored transposed, one row of "Batch_Size" bytes
+  per cell, so each line's sums for the whole batch take a few
+  byte-wise vector additions.  No sum exceeds 5 * 19, so bytes do not
+  overflow.  Solutions are passed to "consume_fun" when the batch is
+  flushed, which happens when it fills up, on bailing out, and at the
+  end of the search.
+*/
+template<typename Consume>
+struct BatchedCheck
 {
-  BoardState{dump<VecUInt8>}.solve_test_as_lines_filled<FO>();
-}
+  static constexpr size_t Batch_Size = 64;
 
-void solve_deduce_last_cell_of_line()
-{
-  for (size_t i = 0; i != 99; ++i)
-    BoardState{ignore<VecUInt8>}.solve_deduce_last_cell_of_line();
+  alignas(64) uint8_t cells[N_Hexes][Batch_Size];
+  size_t n_boards = 0;
+  Consume & consume_fun;
 
-  BoardState{dump<VecUInt8>}.solve_deduce_last_cell_of_line();
-}
+  explicit BatchedCheck(Consume & consume_fun)
+    : consume_fun(consume_fun)
+  {
+  }
 
-template<RecursionStrategy RS>
+  void add(const VecUInt8 & board)
+  {
+    // The boards already batched are checked before bailing out.
+    count_attempt<false>(board, [this]() { flush(); });
+
+    // Byte stores may alias anything, so read through locals to keep
+    // the compiler from reloading the board's data pointer each time.
+    const uint8_t * values = board.data();
+    uint8_t * column = &cells[0][n_boards];
+    for (size_t i = 0; i != N_Hexes; ++i)
+      column[i * Batch_Size] = values[i];
+    if (++n_boards == Batch_Size)
+      flush();
+  }
+
+  // Bit "b" is set if board "b" of the batch has every line correct.
+  uint64_t solution_mask() const
+  {
+    uint64_t mask = 0;
+#if defined(__AVX512BW__)
+    const __m512i target = _mm512_set1_epi8(Required_Sum);
+    __mmask64 all_correct = ~__mmask64{0};
+    for (const auto & line : hex_line_table) {
+      __m512i sum = _mm512_load_si512(cells[line.cells[0]]);
+      for (size_t i = 1; i != line.n_cells; ++i)
+        sum = _mm512_add_epi8(sum, _mm512_load_si512(cells[line.cells[i]]));
+      all_correct &= _mm512_cmpeq_epi8_mask(sum, target);
+    }
+    mask = all_correct;
+#elif defined(__AVX2__)
+    const __m256i target = _mm256_set1_epi8(Required_Sum);
+    for (size_t offset = 0; offset != Batch_Size; offset += 32) {
+      __m256i all_correct = _mm256_set1_epi8(-1);
+      for (const auto & line : hex_line_table) {
+        __m256i sum = _mm256_load_si256(
+          reinterpret_cast<const __m256i *>(cells[line.cells[0]] + offset));
+        for (size_t i = 1; i != line.n_cells; ++i)
+          sum = _mm256_add_epi8(sum, _mm256_load_si256(
+            reinterpret_cast<const __m256i *>(cells[line.cells[i]] + offset)));
+        all_correct = _mm256_and_si256(all_correct, _mm256_cmpeq_epi8(sum, target));
+      }
+      mask |= (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(all_correct)))
+               << offset);
+    }
+#elif defined(__SSE2__)
+    const __m128i target = _mm_set1_epi8(Required_Sum);
+    for (size_t offset = 0; offset != Batch_Size; offset += 16) {
+      __m128i all_correct = _mm_set1_epi8(-1);
+      for (const auto & line : hex_line_table) {
+        __m128i sum = _mm_load_si128(
+          reinterpret_cast<const __m128i *>(cells[line.cells[0]] + offset));
+        for (size_t i = 1; i != line.n_cells; ++i)
+          sum = _mm_add_epi8(sum, _mm_load_si128(
+            reinterpret_cast<const __m128i *>(cells[line.cells[i]] + offset)));
+        all_correct = _mm_and_si128(all_correct, _mm_cmpeq_epi8(sum, target));
+      }
+      mask |= (static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(all_correct)))
+               << offset);
+    }
+#else
+    for (size_t b = 0; b != Batch_Size; ++b) {
+      bool all_correct = true;
+      for (const auto & line : hex_line_table) {
+        int sum = 0;
+        for (size_t i = 0; i != line.n_cells; ++i)
+          sum += cells[line.cells[i]][b];
+        all_correct = all_correct && (sum == Required_Sum);
+      }
+      mask |= static_cast<uint64_t>(all_correct) << b;
+    }
+#endif
+    return mask;
+  }
+
+  void flush()
+  {
+    // Rows beyond "n_boards" hold stale boards from the previous batch.
+    uint64_t mask = solution_mask();
+    if (n_boards != Batch_Size)
+      mask &= (uint64_t{1} << n_boards) - 1;
+    n_boards = 0;
+
+    VecUInt8 board(N_Hexes);
+    while (mask != 0) {
+      const size_t b = __builtin_ctzll(mask);
+      for (size_t i = 0; i != N_Hexes; ++i)
+        board[i] = cells[i][b];
+      consume_fun(board);
+      mask &= mask - 1;
+    }
+  }
+};
+
+template<typename T>
+void dump(const T & board)
+{
+  std::cout << "HEX:";
+  for (const uint8_t n : board)
+    std::cout << " " << static_cast<int>(n);
+  std::cout << "\n";
+}
+
+/*
+  Solution sinks, for either board type.
+*/
+struct IgnoreSink
+{
+  template<typename BoardT>
+  void operator()(const BoardT & /* board */) {}
+};
+
+template<typename BoardT>
+struct CollectSink
+{
+  std::vector<BoardT> boards;
+
+  void operator()(const BoardT & board) { boards.push_back(board); }
+};
+
+// Writes solutions in the same "HEX:" format as dump(), to any stream.
+struct StreamSink
+{
+  std::ostream & out;
+
+  template<typename BoardT>
+  void operator()(const BoardT & board)
+  {
+    out << "HEX:";
+    for (const uint8_t n : board)
+      out << " " << static_cast<int>(n);
+    out << "\n";
+  }
+};
+
+// Passes on all twelve rotations and reflections of each solution.
+template<typename Inner>
+struct AllSymmetriesSink
+{
+  Inner & inner;
+
+  void operator()(const ArrUInt8 & board)
+  {
+    for (const auto & map : spiral_symmetries)
+      inner(transformed_board(board, map));
+  }
+};
+
+/*
+  Compact binary solution files, for runs with too many solutions to
+  print as text.  The 20-byte header is "HEXSOLN1"; the hexagon's
+  order; the number of cells; the order the cells are listed in (see
+  "CellOrdering"); the bits per cell; and the number of boards as a
+  little-endian uint64, all ones if the writer did not finish.  Boards
+  follow, each packed least-significant bit first into whole bytes, so
+  an order-3 board of 5-bit cells takes 12 bytes.
+*/
+enum class CellOrdering : uint8_t { Raster = 0, Spiral = 1 };
+
+/*
+  Solvers store the board in the order they fill it, but solutions are
+  always reported in raster order.  This is the raster index of each
+  position of the boards the running strategy produces, or empty if
+  they are in raster order already.
+*/
+static std::vector<size_t> output_raster_index;
+
+struct BinarySolutionFormat
+{
+  static constexpr char Magic[8] = {'H', 'E', 'X', 'S', 'O', 'L', 'N', '1'};
+  static const size_t Header_Size = 20;
+  static const size_t Count_Offset = 12;
+  static const uint64_t Unknown_Count = ~uint64_t{0};
+
+  static uint8_t bits_per_cell(size_t max_value)
+  {
+    uint8_t n_bits = 1;
+    while (n_bits != 8 && (size_t{1} << n_bits) <= max_value)
+      ++n_bits;
+    return n_bits;
+  }
+
+  static size_t bytes_per_board(size_t n_cells, uint8_t bits_per_cell)
+  {
+    return (n_cells * bits_per_cell + 7) / 8;
+  }
+
+  static size_t order_of(size_t n_cells)
+  {
+    size_t order = 1;
+    while (3 * order * (order - 1) + 1 < n_cells)
+      ++order;
+    return order;
+  }
+};
+
+struct BinarySolutionWriter
+{
+  static const size_t Buffer_Size = 1 << 16;
+
+  std::ofstream out;
+  size_t n_cells;
+  uint8_t bits_per_cell;
+  size_t bytes_per_board;
+  uint64_t n_boards = 0;
+  std::vector<char> buffer;
+
+  BinarySolutionWriter(const std::string & path,
+                       size_t n_cells,
+                       size_t max_value,
+                       CellOrdering ordering)
+    : out(path, std::ios::binary)
+    , n_cells(n_cells)
+    , bits_per_cell(BinarySolutionFormat::bits_per_cell(max_value))
+    , bytes_per_board(BinarySolutionFormat::bytes_per_board(n_cells, bits_per_cell))
+  {
+    if (!out)
+      throw std::runtime_error("could not open " + path);
+
+    out.write(BinarySolutionFormat::Magic, sizeof(BinarySolutionFormat::Magic));
+    out.put(static_cast<char>(BinarySolutionFormat::order_of(n_cells)));
+    out.put(static_cast<char>(n_cells));
+    out.put(static_cast<char>(ordering));
+    out.put(static_cast<char>(bits_per_cell));
+    write_count(BinarySolutionFormat::Unknown_Count);
+    buffer.reserve(Buffer_Size);
+  }
+
+  ~BinarySolutionWriter()
+  {
+    flush_buffer();
+    out.seekp(BinarySolutionFormat::Count_Offset);
+    write_count(n_boards);
+  }
+
+  void write_count(uint64_t count)
+  {
+    for (size_t i = 0; i != 8; ++i)
+      out.put(static_cast<char>(count >> (8 * i)));
+  }
+
+  template<typename BoardT>
+  void write(const BoardT & board)
+  {
+    if (buffer.size() + bytes_per_board > Buffer_Size)
+      flush_buffer();
+
+    uint32_t bits = 0;
+    size_t n_bits = 0;
+    for (const uint8_t n : board) {
+      bits |= static_cast<uint32_t>(n) << n_bits;
+      n_bits += bits_per_cell;
+      for (; n_bits >= 8; n_bits -= 8, bits >>= 8)
+        buffer.push_back(static_cast<char>(bits));
+    }
+    if (n_bits != 0)
+      buffer.push_back(static_cast<char>(bits));
+    ++n_boards;
+  }
+
+  void flush_buffer()
+  {
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+  }
+};
+
+/*
+  Print the boards of a binary solution file as "HEX:" lines, in the
+  cell ordering recorded in it.  Returns false if the file is not
+  valid.
+*/
+bool decode_binary_solutions(const std::string & path)
+{
+  std::ifstream in{path, std::ios::binary};
+  char header[BinarySolutionFormat::Header_Size];
+  if (!in.read(header, sizeof(header))
+      || !std::equal(header, header + 8, BinarySolutionFormat::Magic)) {
+    std::cerr << path << " is not a binary solution file\n";
+    return false;
+  }
+
+  const size_t n_cells = static_cast<uint8_t>(header[9]);
+  const auto ordering = static_cast<CellOrdering>(header[10]);
+  const uint8_t bits_per_cell = static_cast<uint8_t>(header[11]);
+  uint64_t n_boards = 0;
+  for (size_t i = 0; i != 8; ++i)
+    n_boards |= (static_cast<uint64_t>(static_cast<uint8_t>(
+                   header[BinarySolutionFormat::Count_Offset + i])) << (8 * i));
+  if (bits_per_cell == 0 || bits_per_cell > 8) {
+    std::cerr << path << " has an unsupported cell size\n";
+    return false;
+  }
+  if (ordering == CellOrdering::Spiral && n_cells != N_Hexes) {
+    std::cerr << path << " has spiral-order boards of unknown size\n";
+    return false;
+  }
+
+  const size_t bytes_per_board = BinarySolutionFormat::bytes_per_board(n_cells, bits_per_cell);
+  const uint32_t cell_mask = (1u << bits_per_cell) - 1;
+  std::vector<char> packed(bytes_per_board);
+  VecUInt8 board(n_cells);
+  VecUInt8 raster_board(n_cells);
+  uint64_t n_decoded = 0;
+  while (n_decoded != n_boards && in.read(packed.data(), packed.size())) {
+    uint32_t bits = 0;
+    size_t n_bits = 0;
+    size_t byte_idx = 0;
+    for (auto & n : board) {
+      for (; n_bits < bits_per_cell; n_bits += 8)
+        bits |= static_cast<uint32_t>(static_cast<uint8_t>(packed[byte_idx++])) << n_bits;
+      n = static_cast<uint8_t>(bits & cell_mask);
+      bits >>= bits_per_cell;
+      n_bits -= bits_per_cell;
+    }
+    if (ordering == CellOrdering::Spiral) {
+      for (size_t i = 0; i != n_cells; ++i)
+        raster_board[spiral_to_raster[i]] = board[i];
+      dump(raster_board);
+    }
+    else
+      dump(board);
+    ++n_decoded;
+  }
+
+  if (n_boards != BinarySolutionFormat::Unknown_Count && n_decoded != n_boards) {
+    std::cerr << path << " is truncated: " << n_decoded << " of "
+              << n_boards << " boards\n";
+    return false;
+  }
+  return true;
+}
+
+/*
+  Hands solutions from the search to a writer thread, which formats and
+  writes them out in batches, so a slow output does not stall the
+  search until the queue is full.  Sinks are only ever called from one
+  thread (the parallel strategies gather their tasks' solutions first),
+  so the queue is a lock-free single-producer single-consumer ring of
+  fixed-size board slots.  When the ring is empty the writer sleeps
+  until the search queues a solution or finishes, so it does not take a
+  core from the search.  When the ring is full the search waits for
+  the writer; how often, and for how long, is reported at the end.
+*/
+struct SolutionPipeline
+{
+  const size_t n_cells;
+  const size_t capacity;
+  BinarySolutionWriter * const binary_out;
+  VecUInt8 slots;
+
+  alignas(64) std::atomic<size_t> head{0};  // next slot for the search
+  alignas(64) std::atomic<size_t> tail{0};  // next slot for the writer
+  std::atomic<bool> done{false};
+  std::mutex wakeup_mutex;
+  std::condition_variable wakeup;
+
+  // Producer side.
+  size_t n_pushed = 0;
+  size_t n_waits = 0;
+  double wait_seconds = 0.0;
+
+  // Writer side.
+  size_t n_batches = 0;
+  size_t max_batch_size = 0;
+
+  std::thread writer;
+
+  SolutionPipeline(size_t n_cells, size_t capacity, BinarySolutionWriter * binary_out)
+    : n_cells(n_cells)
+    , capacity(capacity)
+    , binary_out(binary_out)
+    , slots(n_cells * capacity)
+    , writer([this]() { write_until_done(); })
+  {
+  }
+
+  ~SolutionPipeline() { finish(); }
+
+  template<typename BoardT>
+  void push(const BoardT & board)
+  {
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == capacity) {
+      ++n_waits;
+      const auto wait_start = std::chrono::steady_clock::now();
+      while (h - tail.load(std::memory_order_acquire) == capacity)
+        std::this_thread::yield();
+      wait_seconds += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - wait_start).count();
+    }
+    std::copy(board.begin(), board.end(), slots.begin() + (h % capacity) * n_cells);
+    head.store(h + 1);
+    ++n_pushed;
+
+    // The writer only sleeps after taking everything up to "h", and
+    // it checks "head" again, under the mutex, after storing "tail";
+    // these sequentially consistent accesses mean that if it missed
+    // this board, "tail" is seen here to have reached "h".
+    if (tail.load() == h) {
+      std::lock_guard<std::mutex> lock{wakeup_mutex};
+      wakeup.notify_one();
+    }
+  }
+
+  void write_until_done()
+  {
+    std::ostringstream text;
+    StreamSink text_sink{text};
+    VecUInt8 board(n_cells);
+
+    while (true) {
+      const bool was_done = done.load(std::memory_order_acquire);
+      const size_t t = tail.load(std::memory_order_relaxed);
+      const size_t h = head.load(std::memory_order_acquire);
+      if (t == h) {
+        if (was_done)
+          return;
+        std::unique_lock<std::mutex> lock{wakeup_mutex};
+        wakeup.wait(lock, [this, t]() { return done.load() || head.load() != t; });
+        continue;
+      }
+
+      for (size_t i = t; i != h; ++i) {
+        const auto slot = slots.begin() + (i % capacity) * n_cells;
+        std::copy(slot, slot + n_cells, board.begin());
+        if (binary_out != nullptr)
+          binary_out->write(board);
+        else
+          text_sink(board);
+      }
+      tail.store(h);
+
+      if (binary_out == nullptr) {
+        std::cout << text.str() << std::flush;
+        text.str("");
+      }
+      ++n_batches;
+      max_batch_size = std::max(max_batch_size, h - t);
+    }
+  }
+
+  // Write out everything still queued, and stop the writer.
+  void finish()
+  {
+    if (!writer.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock{wakeup_mutex};
+      done.store(true);
+    }
+    wakeup.notify_one();
+    writer.join();
+  }
+
+  void print_stats() const
+  {
+    std::cout << "PIPELINE: solutions " << n_pushed
+              << " batches " << n_batches
+              << " largest_batch " << max_batch_size
+              << " search_waits " << n_waits
+              << " wait_seconds " << wait_seconds << "\n";
+  }
+};
+
+/*
+  Sink for the reported run of each strategy.  Prints each solution in
+  raster order, or writes it to "binary_out" if set, or queues it on
+  "pipeline" for its writer to do so, unless only counting, and stops
+  the search once "n_wanted" solutions have been found (zero meaning
+  find them all), saving the checkpoint first if there is one.
+  "raster_board" is allocated up front, for the remapping.
+*/
+struct ReportSink
+{
+  bool print_solutions;
+  size_t n_wanted;
+  VecUInt8 raster_board;
+  BinarySolutionWriter * binary_out = nullptr;
+  SolutionPipeline * pipeline = nullptr;
+  size_t n_solutions = 0;
+
+  template<typename BoardT>
+  void operator()(const BoardT & board)
+  {
+    if (!skip_solution.empty()) {
+      const bool skip = std::equal(board.begin(), board.end(),
+                                   skip_solution.begin(), skip_solution.end());
+      skip_solution.clear();
+      if (skip)
+        return;
+    }
+    ++n_solutions;
+    if (print_solutions) {
+      if (output_raster_index.empty())
+        report(board);
+      else {
+        for (size_t i = 0; i != raster_board.size(); ++i)
+          raster_board[output_raster_index[i]] = board[i];
+        report(raster_board);
+      }
+    }
+    if (n_solutions == n_wanted) {
+      if (!checkpoint_path.empty())
+        save_checkpoint(board, n_attempts_before_position,
+                        CheckpointState::StoppedAtSolution);
+      throw SearchStopped{};
+    }
+  }
+
+  template<typename BoardT>
+  void report(const BoardT & board)
+  {
+    if (pipeline != nullptr)
+      pipeline->push(board);
+    else if (binary_out != nullptr)
+      binary_out->write(board);
+    else
+      dump(board);
+  }
+};
+
+struct CommandLineOptions
+{
+  size_t order = 3;
+  std::vector<size_t> fill_order;
+  size_t beam_width = 200;
+  size_t n_orders_measured = 8;
+  bool expand_symmetries = false;
+  bool collect_stats = false;
+  bool count_only = false;
+  bool exists_only = false;
+  size_t n_solutions_wanted = 0;
+  uint64_t start_rank = 0;
+  uint64_t n_ranks = 2500000000;
+  uint64_t chunk_n_ranks = 1 << 24;
+  size_t n_shards = 64;
+  bool resume = false;
+  std::string binary_output_path;
+  VecUInt8 values;
+  int required_sum = -1;
+  bool all_sums = false;
+  bool use_fast_path = true;
+  bool pool_allocator = false;
+  bool perf_counters = false;
+  size_t split_depth = 4;
+  size_t async_queue_size = 0;
+  size_t memo_n_entries = 0;
+  int memo_depth = -1;
+  std::string regress_baseline_path;
+  double regress_max_slowdown = 0.05;
+  std::string worker_id;
+  double reclaim_after_seconds = 0.0;
+  std::string bench_format = "json";
+  size_t bench_n_warmup_runs = 1;
+  size_t bench_min_runs = 5;
+  size_t bench_max_runs = 200;
+  double bench_max_seconds = 30.0;
+  double bench_target_ci = 0.02;
+};
+
+static CommandLineOptions options;
+
+enum class FillOrder { Raster, Spiral };
+
+/*
+  Instrumentation policies for the solvers.  "NoStats" compiles away
+  entirely.  "DepthStats" counts, at each depth (number of cells filled
+  on entry), the nodes visited, the deductions attempted, how many of
+  those failed because the needed value was not available, and how many
+  candidates were pruned by a check.  It only holds a pointer to the
+  counters, so solvers which clone themselves all count into the same
+  place.
+*/
+struct NoStats
+{
+  void count_node(size_t /* depth */) {}
+  void count_deduction(size_t /* depth */, bool /* found */) {}
+  void count_prune(size_t /* depth */) {}
+};
+
+struct DepthCounters
+{
+  std::vector<size_t> n_nodes;
+  std::vector<size_t> n_deductions;
+  std::vector<size_t> n_deductions_failed;
+  std::vector<size_t> n_prunes;
+
+  explicit DepthCounters(size_t n_cells)
+    : n_nodes(n_cells + 1)
+    , n_deductions(n_cells + 1)
+    , n_deductions_failed(n_cells + 1)
+    , n_prunes(n_cells + 1)
+  {
+  }
+
+  void add(const DepthCounters & other)
+  {
+    for (size_t d = 0; d != n_nodes.size(); ++d) {
+      n_nodes[d] += other.n_nodes[d];
+      n_deductions[d] += other.n_deductions[d];
+      n_deductions_failed[d] += other.n_deductions_failed[d];
+      n_prunes[d] += other.n_prunes[d];
+    }
+  }
+
+  size_t total_n_nodes() const
+  {
+    return std::accumulate(n_nodes.begin(), n_nodes.end(), size_t{0});
+  }
+
+  void print() const
+  {
+    std::cout << "STATS: depth nodes deductions deductions_failed prunes\n";
+    for (size_t d = 0; d != n_nodes.size(); ++d) {
+      std::cout << "STATS: " << d << " " << n_nodes[d]
+                << " " << n_deductions[d] << " " << n_deductions_failed[d]
+                << " " << n_prunes[d] << "\n";
+    }
+  }
+};
+
+struct DepthStats
+{
+  DepthCounters * counters;
+
+  void count_node(size_t depth) { ++counters->n_nodes[depth]; }
+
+  void count_deduction(size_t depth, bool found)
+  {
+    ++counters->n_deductions[depth];
+    counters->n_deductions_failed[depth] += !found;
+  }
+
+  void count_prune(size_t depth) { ++counters->n_prunes[depth]; }
+};
+
+/*
+  Hardware counters for "--perf": cycles, instructions, branch misses
+  and L1 data-cache read misses over the reported search of a strategy,
+  including any threads it starts, plus the CPU time used, which the kernel can
+  count even where there is no hardware PMU.  Each event is opened on
+  its own, so one the machine lacks is reported as unavailable rather
+  than losing them all.  If the kernel had to multiplex the events onto
+  fewer hardware counters, the counts are scaled up by the fraction of
+  time counted.
+*/
+struct PerfCounters
+{
+  struct Event
+  {
+    const char * name;
+    uint32_t type;
+    uint64_t config;
+    int fd;
+    std::string error;
+
+    Event(const char * name, uint32_t type, uint64_t config)
+      : name(name), type(type), config(config), fd(-1)
+    {
+    }
+  };
+
+  std::vector<Event> events;
+
+  PerfCounters()
+  {
+#if defined(__linux__)
+    events.emplace_back("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    events.emplace_back("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    events.emplace_back("branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    events.emplace_back("l1d_read_misses", PERF_TYPE_HW_CACHE,
+                        (PERF_COUNT_HW_CACHE_L1D
+                         | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                         | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)));
+    events.emplace_back("task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+
+    for (auto & event : events) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = event.type;
+      attr.config = event.config;
+      attr.disabled = 1;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      event.fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      if (event.fd == -1)
+        event.error = std::strerror(errno);
+    }
+#else
+    for (const char * name : {"cycles", "instructions", "branch_misses",
+                              "l1d_read_misses", "task_clock_ns"}) {
+      events.emplace_back(name, 0, 0);
+      events.back().error = "needs Linux";
+    }
+#endif
+  }
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters & operator=(const PerfCounters &) = delete;
+
+  ~PerfCounters()
+  {
+    for (const auto & event : events)
+      if (event.fd != -1)
+        close(event.fd);
+  }
+
+  void start()
+  {
+#if defined(__linux__)
+    for (const auto & event : events) {
+      if (event.fd != -1) {
+        ioctl(event.fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(event.fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+
+  void stop()
+  {
+#if defined(__linux__)
+    for (const auto & event : events)
+      if (event.fd != -1)
+        ioctl(event.fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+  }
+
+  void print() const
+  {
+    for (const auto & event : events) {
+      std::cout << "PERF: " << event.name << " ";
+      uint64_t values[3] = {0, 0, 0};  // count, time enabled, time running
+      if (event.fd == -1)
+        std::cout << "unavailable (" << event.error << ")\n";
+      else if (read(event.fd, values, sizeof(values)) != sizeof(values))
+        std::cout << "unavailable (could not read)\n";
+      else if (values[2] == 0)
+        std::cout << "unavailable (never scheduled)\n";
+      else if (values[2] < values[1])
+        std::cout << static_cast<uint64_t>(static_cast<double>(values[0])
+                                           * values[1] / values[2])
+                  << " (scaled)\n";
+      else
+        std::cout << values[0] << "\n";
+    }
+  }
+};
+
+template<typename NumbersT>
+bool raster_incorrect_already(const NumbersT & board)
+{
+  const size_t n_filled = board.size();
+  return ((n_filled == 3 && !sum_correct(board, 0, 1, 2))
+          || (n_filled == 7 && !sum_correct(board, 3, 4, 5, 6))
+          || (n_filled == 8 && !sum_correct(board, 0, 3, 7))
+          || (n_filled == 12 && !sum_correct(board, 7, 8, 9, 10, 11))
+          || (n_filled == 12 && !sum_correct(board, 2, 6, 11))
+          || (n_filled == 13 && !sum_correct(board, 1, 4, 8, 12))
+          || (n_filled == 16 && !sum_correct(board, 12, 13, 14, 15))
+          || (n_filled == 16 && !sum_correct(board, 1, 5, 10, 15))
+          || (n_filled == 17 && !sum_correct(board, 7, 12, 16))
+          || (n_filled == 17 && !sum_correct(board, 2, 5, 9, 13, 16))
+          || (n_filled == 18 && !sum_correct(board, 3, 8, 13, 17))
+          || (n_filled == 18 && !sum_correct(board, 6, 10, 14, 17))
+          || (n_filled == 19 && !sum_correct(board, 0, 4, 9, 14, 18))
+          || (n_filled == 19 && !sum_correct(board, 11, 15, 18))
+          || (n_filled == 19 && !sum_correct(board, 16, 17, 18)));
+}
+
+template<typename NumbersT>
+bool spiral_incorrect_already(const NumbersT & board)
+{
+  const size_t n_filled = board.size();
+  return ((n_filled == 3 && !sum_correct(board, 0, 1, 2))
+          || (n_filled == 5 && !sum_correct(board, 2, 3, 4))
+          || (n_filled == 7 && !sum_correct(board, 4, 5, 6))
+          || (n_filled == 9 && !sum_correct(board, 6, 7, 8))
+          || (n_filled == 11 && !sum_correct(board, 8, 9, 10))
+          || (n_filled == 12 && !sum_correct(board, 0, 10, 11))
+          || (n_filled == 14 && !sum_correct(board, 3, 11, 12, 13))
+          || (n_filled == 15 && !sum_correct(board, 1, 13, 14, 5))
+          || (n_filled == 16 && !sum_correct(board, 3, 14, 15, 7))
+          || (n_filled == 17 && !sum_correct(board, 5, 15, 16, 9))
+          || (n_filled == 18 && !sum_correct(board, 7, 16, 17, 11))
+          || (n_filled == 18 && !sum_correct(board, 1, 12, 17, 9))
+          || (n_filled == 19 && !sum_correct(board, 0, 12, 18, 15, 6))
+          || (n_filled == 19 && !sum_correct(board, 2, 13, 18, 16, 8))
+          || (n_filled == 19 && !sum_correct(board, 4, 14, 18, 17, 10)));
+}
+
+template<FillOrder FO, typename NumbersT>
+bool incorrect_already(const NumbersT & board)
+{
+  if constexpr (FO == FillOrder::Raster)
+    return raster_incorrect_already(board);
+  else
+    return spiral_incorrect_already(board);
+}
+
+/*
+  Allocator for the vectors of "BoardStateT", selected by "--allocator
+  pool".  Every one of those vectors holds at most N_Hexes values, even
+  while growing, so all allocations come from a free list of
+  fixed-size blocks.  The search frees a child's vectors before making
+  the next sibling, so the same few blocks are reused at each depth and
+  allocating is a pop and freeing a push.  Blocks are carved from
+  chunks which live until the program exits.  The pool is per thread;
+  the solvers using it are single-threaded.
+*/
+struct BoardBlockPool
+{
+  static constexpr size_t Block_Size = 64;
+  static constexpr size_t Blocks_Per_Chunk = 1024;
+
+  union Block
+  {
+    Block * next;
+    alignas(std::max_align_t) unsigned char bytes[Block_Size];
+  };
+
+  Block * free_list = nullptr;
+  std::vector<std::unique_ptr<Block[]>> chunks;
+
+  void * allocate()
+  {
+    if (free_list == nullptr) {
+      chunks.emplace_back(new Block[Blocks_Per_Chunk]);
+      for (size_t i = 0; i != Blocks_Per_Chunk; ++i) {
+        chunks.back()[i].next = free_list;
+        free_list = &chunks.back()[i];
+      }
+    }
+    Block * block = free_list;
+    free_list = block->next;
+    return block;
+  }
+
+  void deallocate(void * p)
+  {
+    Block * block = static_cast<Block *>(p);
+    block->next = free_list;
+    free_list = block;
+  }
+
+  static BoardBlockPool & instance()
+  {
+    static thread_local BoardBlockPool pool;
+    return pool;
+  }
+};
+
+template<typename T>
+struct BoardPoolAllocator
+{
+  using value_type = T;
+
+  BoardPoolAllocator() = default;
+
+  template<typename U>
+  BoardPoolAllocator(const BoardPoolAllocator<U> &) {}
+
+  T * allocate(size_t n)
+  {
+    if (n * sizeof(T) > BoardBlockPool::Block_Size)
+      return static_cast<T *>(::operator new(n * sizeof(T)));
+    return static_cast<T *>(BoardBlockPool::instance().allocate());
+  }
+
+  void deallocate(T * p, size_t n)
+  {
+    if (n * sizeof(T) > BoardBlockPool::Block_Size)
+      ::operator delete(p);
+    else
+      BoardBlockPool::instance().deallocate(p);
+  }
+
+  template<typename U>
+  bool operator==(const BoardPoolAllocator<U> &) const { return true; }
+
+  template<typename U>
+  bool operator!=(const BoardPoolAllocator<U> &) const { return false; }
+};
+
+using PoolVecUInt8 = std::vector<uint8_t, BoardPoolAllocator<uint8_t>>;
+
+/*
+  The solvers are templated on the type of the solution sink ("Consume"
+  below), and hold it by reference, so cloning a solver just copies a
+  pointer and calling the sink is a direct, inlinable, call.  "Vec" is
+  the type of the board and available-number vectors, so the same
+  search can run on "PoolVecUInt8".
+*/
+template<typename Consume, typename Stats = NoStats, typename Vec = VecUInt8>
+struct BoardStateT
+{
+  Vec board;
+  Vec available;
+  Consume & consume_fun;
+  Stats stats;
+
+  BoardStateT(Consume & consume_fun, Stats stats = Stats{})
+    : available(N_Hexes)
+    , consume_fun(consume_fun)
+    , stats(stats)
+  {
+    std::iota(available.begin(), available.end(), 1);
+  }
+
+  BoardStateT(const BoardStateT & rhs)
+    : board(rhs.board)
+    , available(rhs.available)
+    , consume_fun(rhs.consume_fun)
+    , stats(rhs.stats)
+  {
+  }
+
+  // When resuming, the search carries on as normal once it reaches
+  // "resume_board" itself.  Called at each node before
+  // "first_idx_to_explore()".
+  void finish_resume()
+  {
+    if (!resume_board.empty() && board.size() == resume_board.size())
+      resume_board.clear();
+  }
+
+  // Until then, the first child to explore is the one on the way to
+  // "resume_board".
+  size_t first_idx_to_explore() const
+  {
+    if (resume_board.empty())
+      return 0;
+    return std::find(available.begin(), available.end(), resume_board[board.size()])
+      - available.begin();
+  }
+
+  template<typename Check>
+  void solve_check_when_full()
+  {
+    stats.count_node(board.size());
+    finish_resume();
+
+    if (available.size() == 0) {
+      if (Check::is_solution(board))
+        consume_fun(board);
+      else
+        stats.count_prune(board.size());
+    }
+    else {
+      const auto n_available = available.size();
+      for (size_t idx = first_idx_to_explore(); idx != n_available; ++idx) {
+        auto new_board_state = BoardStateT{*this};
+        new_board_state.board.push_back(available[idx]);
+        new_board_state.available.erase(
+          new_board_state.available.begin() + idx
+        );
+        new_board_state.template solve_check_when_full<Check>();
+      }
+    }
+  }
+
+  template<FillOrder FO>
+  void solve_test_as_lines_filled()
+  {
+    stats.count_node(board.size());
+    note_search_position(board, n_attempts);
+    finish_resume();
+    const size_t first_idx = first_idx_to_explore();
+
+    if (incorrect_already<FO>(board)) {
+      stats.count_prune(board.size());
+      return;
+    }
+
+    const auto n_available = available.size();
+    if (n_available == 0) {
+      consume_fun(board);
+      return;
+    }
+
+    for (size_t idx = first_idx; idx != n_available; ++idx) {
+      auto new_board_state = BoardStateT{*this};
+      new_board_state.board.push_back(available[idx]);
+      new_board_state.available.erase(new_board_state.available.begin() + idx);
+      new_board_state.template solve_test_as_lines_filled<FO>();
+    }
+  }
+};
+
+/*
+  A partly-filled board together with its set of available values,
+  packed into one 128-bit value so that copying it is a single register
+  move with no allocation.  The cells, in spiral order, take five bits
+  each in bits [0, 95); bit 96 + (v - 1) is set while value "v" is
+  still available; and the number of cells filled so far is in the top
+  bits.
+*/
+struct PackedBoard
+{
+  using Bits = unsigned __int128;
+
+  static constexpr unsigned Cell_Bits = 5;
+  static constexpr unsigned Available_Shift = 96;
+  static constexpr unsigned Count_Shift = Available_Shift + N_Hexes;
+
+  static_assert(N_Hexes * Cell_Bits <= Available_Shift, "cells must fit below the mask");
+  static_assert(N_Hexes < (1u << Cell_Bits), "values must fit in a cell");
+  static_assert(Count_Shift + Cell_Bits <= 128, "fill count must fit in the top bits");
+
+  Bits bits;
+
+  // The empty board, with the values 1..N_Hexes available.
+  PackedBoard()
+    : bits(static_cast<Bits>((1u << N_Hexes) - 1u) << Available_Shift)
+  {
+  }
+
+  uint8_t cell(size_t pos) const
+  {
+    return static_cast<uint8_t>(bits >> (pos * Cell_Bits)) & ((1u << Cell_Bits) - 1u);
+  }
+
+  // Bit (v - 1) is set while value "v" is available.
+  uint32_t available() const
+  {
+    return static_cast<uint32_t>(bits >> Available_Shift) & ((1u << N_Hexes) - 1u);
+  }
+
+  bool is_available(uint8_t value) const
+  {
+    return value >= 1 && value <= N_Hexes && ((available() >> (value - 1)) & 1u);
+  }
+
+  size_t n_filled() const
+  {
+    return static_cast<size_t>(bits >> Count_Shift);
+  }
+
+  // This board with "value" placed in the next cell, spiral position
+  // "Pos", which must be the number of cells filled so far.
+  template<size_t Pos>
+  PackedBoard with_next(uint8_t value) const
+  {
+    PackedBoard next = *this;
+    next.bits |= static_cast<Bits>(value) << (Pos * Cell_Bits);
+    next.bits &= ~(static_cast<Bits>(1u) << (Available_Shift + value - 1));
+    next.bits += static_cast<Bits>(1u) << Count_Shift;
+    return next;
+  }
+
+  ArrUInt8 unpacked() const
+  {
+    ArrUInt8 cells;
+    for (size_t pos = 0; pos != N_Hexes; ++pos)
+      cells[pos] = cell(pos);
+    return cells;
+  }
+};
+
+/*
+  The "deduce" search on a "PackedBoard".  The solver is the board plus
+  a reference to the sink and the stats pointer, so each child is a
+  plain copy.  Choices try the available values in increasing order,
+  as the vector of available numbers did, so solutions come out in the
+  same order as before.
+*/
+template<typename Consume, typename Stats = NoStats>
+struct PackedBoardStateT
+{
+  PackedBoard board;
+  Consume & consume_fun;
+  Stats stats;
+
+  PackedBoardStateT(Consume & consume_fun, Stats stats = Stats{})
+    : consume_fun(consume_fun)
+    , stats(stats)
+  {
+  }
+
+  template<size_t Depth>
+  void explore(uint8_t value)
+  {
+    PackedBoardStateT new_state{*this};
+    new_state.board = board.template with_next<Depth>(value);
+    new_state.template solve<Depth + 1>();
+  }
+
+  template<size_t Depth>
+  void choose()
+  {
+    for (uint32_t left = board.available(); left != 0; left &= left - 1)
+      explore<Depth>(static_cast<uint8_t>(__builtin_ctz(left) + 1));
+  }
+
+  template<size_t Depth, size_t... Is>
+  void deduce(std::index_sequence<Is...>)
+  {
+    uint8_t needed = Required_Sum - (board.cell(spiral_schedule[Depth].have_idxs[Is]) + ...);
+    const bool found = board.is_available(needed);
+    stats.count_deduction(Depth, found);
+    if (found)
+      explore<Depth>(needed);
+  }
+
+  template<size_t Depth = 0>
+  void solve()
+  {
+    stats.count_node(Depth);
+
+    if constexpr (Depth == N_Hexes) {
+      const ArrUInt8 cells = board.unpacked();
+      if (spiral_solution_is_correct(cells))
+        consume_fun(cells);
+      else
+        stats.count_prune(Depth);
+    }
+    else if constexpr (spiral_schedule[Depth].is_choice)
+      choose<Depth>();
+    else
+      deduce<Depth>(std::make_index_sequence<spiral_schedule[Depth].n_have>{});
+  }
+};
+
+/*
+  How the array solver explores each candidate.  "SwapThenRotateBack"
+  differs from "SwapAndSwapBack" only for choices: rather than swapping
+  each candidate back out after exploring it, swap the next candidate
+  straight in.  That leaves the available numbers rotated by one place
+  once every candidate has been tried, and a single rotation puts them
+  back.
+*/
+enum struct RecursionStrategy { CreateNew, SwapAndSwapBack, SwapThenRotateBack };
+
+/*
+  Ways of finding a needed value among the available numbers
+  numbers[Depth..N_Hexes), and of moving the value at "idx" into the
+  next cell numbers[Depth] (and back again afterwards).  A lookup is
+  "stateless" if it keeps nothing besides the numbers themselves, so
+  that they may be moved around without going through "fill".
+*/
+
+// Plain linear scan of the available numbers.
+struct ScanLookup
+{
+  static constexpr bool is_stateless = true;
+
+  explicit ScanLookup(const ArrUInt8 & /* numbers */) {}
+
+  template<size_t Depth>
+  size_t find(const ArrUInt8 & numbers, uint8_t needed_value) const
+  {
+    for (size_t i = Depth; i != N_Hexes; ++i) {
+      if (numbers[i] == needed_value) {
+        return i;
+      }
+    }
+    return N_Hexes;
+  }
+
+  template<size_t Depth>
+  void fill(ArrUInt8 & numbers, size_t idx)
+  {
+    std::swap(numbers[Depth], numbers[idx]);
+  }
+
+  template<size_t Depth>
+  void unfill(ArrUInt8 & numbers, size_t idx)
+  {
+    std::swap(numbers[Depth], numbers[idx]);
+  }
+};
+
+/*
+  Keep a bitmap of which values are available alongside the index of
+  each available value's slot, so a lookup needs no search at all.
+  Filling from "idx" only moves the value displaced from numbers[Depth]
+  into slot "idx", so only that value's index changes; the filled
+  value's stale index is correct again once it is unfilled.
+*/
+struct BitmaskLookup
+{
+  static_assert(N_Hexes < 32, "values must fit in a 32-bit mask");
+
+  static constexpr bool is_stateless = false;
+
+  uint32_t available;
+  std::array<uint8_t, 32> slot_of_value;
+
+  explicit BitmaskLookup(const ArrUInt8 & numbers)
+    : available(0)
+    , slot_of_value{}
+  {
+    for (size_t i = 0; i != N_Hexes; ++i) {
+      available |= 1u << numbers[i];
+      slot_of_value[numbers[i]] = i;
+    }
+  }
+
+  template<size_t Depth>
+  size_t find(const ArrUInt8 & /* numbers */, uint8_t needed_value) const
+  {
+    if (needed_value < 32 && (available >> needed_value) & 1u)
+      return slot_of_value[needed_value];
+    return N_Hexes;
+  }
+
+  template<size_t Depth>
+  void fill(ArrUInt8 & numbers, size_t idx)
+  {
+    std::swap(numbers[Depth], numbers[idx]);
+    slot_of_value[numbers[idx]] = idx;
+    available &= ~(1u << numbers[Depth]);
+  }
+
+  template<size_t Depth>
+  void unfill(ArrUInt8 & numbers, size_t idx)
+  {
+    available |= 1u << numbers[Depth];
+    std::swap(numbers[Depth], numbers[idx]);
+    slot_of_value[numbers[Depth]] = Depth;
+  }
+};
+
+/*
+  Compare every number against the needed value at once.  The 19 bytes
+  do not fit in one SSE register, so compare two overlapping 16-byte
+  loads (bytes 0..15 and 3..18) and merge their match masks.  Values
+  are distinct, so there is at most one match once the filled cells
+  are masked off.
+*/
+struct SimdScanLookup : ScanLookup
+{
+  static_assert(N_Hexes >= 16 && N_Hexes <= 32, "numbers must span two SSE loads");
+
+  using ScanLookup::ScanLookup;
+
+  template<size_t Depth>
+  size_t find(const ArrUInt8 & numbers, uint8_t needed_value) const
+  {
+#if defined(__SSE2__)
+    const __m128i needle = _mm_set1_epi8(static_cast<char>(needed_value));
+    const __m128i low = _mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(numbers.data()));
+    const __m128i high = _mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(numbers.data() + N_Hexes - 16));
+    uint32_t matches = (
+      static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(low, needle)))
+      | (static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(high, needle)))
+         << (N_Hexes - 16)));
+    matches &= ~((1u << Depth) - 1u);
+    return (matches == 0) ? N_Hexes : __builtin_ctz(matches);
+#else
+    return ScanLookup::find<Depth>(numbers, needed_value);
+#endif
+  }
+};
+
+/*
+  Scan as "ScanLookup" does, but expand the scan at each depth into a
+  straight-line sequence of the N_Hexes - Depth comparisons, so the
+  number of available values is a constant in the generated code and
+  each comparison is a branch of its own for the predictor (and a
+  profile) to learn.  "ArrayBoardStateT" expands its choice loop in the
+  same way when using this lookup.
+*/
+struct UnrolledScanLookup : ScanLookup
+{
+  using ScanLookup::ScanLookup;
+
+  template<size_t Depth, size_t... Is>
+  static size_t find_unrolled(const ArrUInt8 & numbers,
+                              uint8_t needed_value,
+                              std::index_sequence<Is...>)
+  {
+    size_t found = N_Hexes;
+    ((numbers[Depth + Is] == needed_value && (found = Depth + Is, true)) || ...);
+    return found;
+  }
+
+  template<size_t Depth>
+  size_t find(const ArrUInt8 & numbers, uint8_t needed_value) const
+  {
+    return find_unrolled<Depth>(numbers, needed_value,
+                                std::make_index_sequence<N_Hexes - Depth>{});
+  }
+};
+
+/*
+  Scan for needed numbers as "ScanLookup" does, but also keep the
+  running sum of every line, in one 16-byte vector with a byte per line
+  (no sum exceeds 5 * 19).  Filling a cell adds its value to the three
+  lines through it with one masked vector add, and unfilling subtracts
+  it again, so a deduction needs one sum rather than adding up the
+  line's cells, and the final check is one vector compare.  Like
+  "BitmaskLookup", it must be constructed for an empty board.
+*/
+using LineSums = std::array<uint8_t, 16>;
+
+// For each spiral position, 0xff in the bytes of the lines through it.
+constexpr std::array<LineSums, N_Hexes> make_spiral_line_masks()
+{
+  std::array<LineSums, N_Hexes> masks{};
+  for (size_t pos = 0; pos != N_Hexes; ++pos)
+    for (size_t line_idx = 0; line_idx != N_Lines; ++line_idx)
+      for (size_t i = 0; i != hex_line_table[line_idx].n_cells; ++i)
+        if (hex_line_table[line_idx].cells[i] == spiral_to_raster[pos])
+          masks[pos][line_idx] = 0xff;
+  return masks;
+}
+
+struct LineSumsLookup : ScanLookup
+{
+  static_assert(N_Lines <= 16, "line sums must fit in one 16-byte vector");
+
+  static constexpr bool is_stateless = false;
+
+  static constexpr std::array<LineSums, N_Hexes> line_masks = make_spiral_line_masks();
+
+  alignas(16) LineSums line_sums;
+
+  explicit LineSumsLookup(const ArrUInt8 & numbers)
+    : ScanLookup(numbers)
+    , line_sums{}
+  {
+  }
+
+  template<size_t Depth>
+  void add_to_lines(uint8_t value, bool subtract)
+  {
+#if defined(__SSE2__)
+    const __m128i mask = _mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(line_masks[Depth].data()));
+    const __m128i delta = _mm_and_si128(
+      _mm_set1_epi8(static_cast<char>(value)), mask);
+    __m128i sums = _mm_load_si128(reinterpret_cast<const __m128i *>(line_sums.data()));
+    sums = subtract ? _mm_sub_epi8(sums, delta) : _mm_add_epi8(sums, delta);
+    _mm_store_si128(reinterpret_cast<__m128i *>(line_sums.data()), sums);
+#else
+    for (size_t line_idx = 0; line_idx != N_Lines; ++line_idx)
+      if (line_masks[Depth][line_idx] != 0)
+        line_sums[line_idx] += subtract ? -value : value;
+#endif
+  }
+
+  template<size_t Depth>
+  void fill(ArrUInt8 & numbers, size_t idx)
+  {
+    std::swap(numbers[Depth], numbers[idx]);
+    add_to_lines<Depth>(numbers[Depth], false);
+  }
+
+  template<size_t Depth>
+  void unfill(ArrUInt8 & numbers, size_t idx)
+  {
+    add_to_lines<Depth>(numbers[Depth], true);
+    std::swap(numbers[Depth], numbers[idx]);
+  }
+
+  bool all_lines_sum_to(uint8_t sum) const
+  {
+#if defined(__SSE2__)
+    const __m128i sums = _mm_load_si128(reinterpret_cast<const __m128i *>(line_sums.data()));
+    const uint32_t matches = _mm_movemask_epi8(
+      _mm_cmpeq_epi8(sums, _mm_set1_epi8(static_cast<char>(sum))));
+    const uint32_t all_lines = (1u << N_Lines) - 1;
+    return (matches & all_lines) == all_lines;
+#else
+    for (size_t line_idx = 0; line_idx != N_Lines; ++line_idx)
+      if (line_sums[line_idx] != sum)
+        return false;
+    return true;
+#endif
+  }
+};
+
+/*
+  Compile-time value sets for the order-3 array solvers: the values to
+  place in the cells, and the magic sum they must give.  The generic
+  engine takes the same configuration at run time, and hands over to
+  an array solver built for one of "Precompiled_Value_Sets" when the
+  run-time configuration matches it.
+*/
+template<uint8_t First>
+struct ConsecutiveValues
+{
+  static constexpr int total = N_Hexes * First + N_Hexes * (N_Hexes - 1) / 2;
+  static_assert(total % 5 == 0, "values must split equally between the five rows");
+  static constexpr uint8_t required_sum = total / 5;
+
+  static ArrUInt8 values()
+  {
+    ArrUInt8 numbers;
+    std::iota(numbers.begin(), numbers.end(), First);
+    return numbers;
+  }
+};
+
+using StandardValues = ConsecutiveValues<1>;
+using Precompiled_Value_Sets = std::tuple<StandardValues, ConsecutiveValues<6>>;
+
+/*
+  The number of cells filled so far is a template parameter throughout,
+  so each level of the search is compiled separately from the schedule,
+  with no run-time dispatch on depth.
+*/
+template<typename Consume,
+         typename Lookup = ScanLookup,
+         bool CanonicalOnly = false,
+         typename Stats = NoStats,
+         typename Values = StandardValues,
+         bool RangePrune = false>
+struct ArrayBoardStateT
+{
+  ArrUInt8 numbers;
+  Lookup lookup;
+  Consume & consume_fun;
+  Stats stats;
+
+  ArrayBoardStateT(Consume & consume_fun, Stats stats = Stats{})
+    : numbers(initial_numbers())
+    , lookup(numbers)
+    , consume_fun(consume_fun)
+    , stats(stats)
+  {
+  }
+
+  ArrayBoardStateT(const ArrayBoardStateT & other)
+    : numbers(other.numbers)
+    , lookup(other.lookup)
+    , consume_fun(other.consume_fun)
+    , stats(other.stats)
+  {
+  }
+
+  static ArrUInt8 initial_numbers()
+  {
+    return Values::values();
+  }
+
+  void set_numbers(const ArrUInt8 & new_numbers)
+  {
+    numbers = new_numbers;
+    lookup = Lookup{numbers};
+  }
+
+  template<size_t Depth, size_t... Is>
+  size_t find_needed_from_schedule(std::index_sequence<Is...>)
+  {
+    const auto & step = spiral_schedule[Depth];
+    uint8_t needed;
+    if constexpr (std::is_same_v<Lookup, LineSumsLookup>)
+      needed = Values::required_sum - lookup.line_sums[step.line_idx];
+    else
+      needed = Values::required_sum - (numbers[step.have_idxs[Is]] + ...);
+    return lookup.template find<Depth>(numbers, needed);
+  }
+
+  template<size_t Depth>
+  size_t find_needed_from_schedule()
+  {
+    return find_needed_from_schedule<Depth>(
+      std::make_index_sequence<spiral_schedule[Depth].n_have>{});
+  }
+
+  template<size_t Depth>
+  bool may_place(size_t idx) const
+  {
+    if constexpr (CanonicalOnly)
+      return corner_value_is_canonical<Depth>(numbers, numbers[idx]);
+    return true;
+  }
+
+  template<RecursionStrategy RS, size_t Depth>
+  void explore_swapped(size_t idx)
+  {
+    if (!may_place<Depth>(idx)) {
+      stats.count_prune(Depth);
+      return;
+    }
+
+    if constexpr (RS == RecursionStrategy::CreateNew) {
+      ArrayBoardStateT swapped_state{*this};
+      swapped_state.lookup.template fill<Depth>(swapped_state.numbers, idx);
+      swapped_state.template solve<RS, Depth + 1>();
+    } else {
+      lookup.template fill<Depth>(numbers, idx);
+      solve<RS, Depth + 1>();
+      lookup.template unfill<Depth>(numbers, idx);
+    }
+  }
+
+  template<RecursionStrategy RS, size_t Depth, size_t... Is>
+  void explore_swapped_each(std::index_sequence<Is...>)
+  {
+    (explore_swapped<RS, Depth>(Depth + 1 + Is), ...);
+  }
+
+  template<RecursionStrategy RS, size_t Depth>
+  void choose()
+  {
+    if constexpr (RS == RecursionStrategy::SwapThenRotateBack) {
+      static_assert(Lookup::is_stateless,
+                    "rotating the numbers is only valid for stateless lookups");
+
+      // Slots (Depth, i) hold the candidates already tried, in order,
+      // and slots [i, N_Hexes) are untouched, so each candidate is
+      // still in its original slot when it is swapped in.
+      for (size_t i = Depth; i != N_Hexes; ++i) {
+        const bool allowed = may_place<Depth>(i);
+        std::swap(numbers[Depth], numbers[i]);
+        if (allowed)
+          solve<RS, Depth + 1>();
+        else
+          stats.count_prune(Depth);
+      }
+      std::rotate(numbers.begin() + Depth, numbers.begin() + Depth + 1, numbers.end());
+      return;
+    }
+
+    if (may_place<Depth>(Depth)) {
+      lookup.template fill<Depth>(numbers, Depth);
+      solve<RS, Depth + 1>();
+      lookup.template unfill<Depth>(numbers, Depth);
+    }
+    else
+      stats.count_prune(Depth);
+    if constexpr (std::is_same_v<Lookup, UnrolledScanLookup>)
+      explore_swapped_each<RS, Depth>(std::make_index_sequence<N_Hexes - Depth - 1>{});
+    else
+      for (size_t i = Depth + 1; i != N_Hexes; ++i)
+        explore_swapped<RS, Depth>(i);
+  }
+
+  template<RecursionStrategy RS, size_t Depth>
+  void deduce()
+  {
+    const size_t maybe_needed_idx = find_needed_from_schedule<Depth>();
+    stats.count_deduction(Depth, maybe_needed_idx != N_Hexes);
+    if (maybe_needed_idx != N_Hexes)
+      explore_swapped<RS, Depth>(maybe_needed_idx);
+  }
+
+  /*
+    With "RangePrune", after filling the cell at "Depth", check every
+    line through it which is still incomplete: its partial sum plus the
+    smallest (largest) values still available for its unfilled cells
+    must not exceed (fall short of) the magic sum.  A line with one cell
+    left needs exactly one value, and values are only used up, never
+    returned, deeper in the search, so it must be available now.  The
+    available values are read from BitmaskLookup's mask.
+  */
+  template<size_t Depth>
+  bool partial_lines_feasible() const
+  {
+    static_assert(std::is_same_v<Lookup, BitmaskLookup>,
+                  "range pruning reads the available values from a bitmask");
+
+    const uint32_t available = lookup.available;
+    const auto & step = spiral_partial_lines[Depth];
+    for (size_t i = 0; i != step.n_lines; ++i) {
+      const auto & line = step.lines[i];
+      int partial_sum = 0;
+      for (size_t j = 0; j != line.n_filled; ++j)
+        partial_sum += numbers[line.filled_idxs[j]];
+      const int needed = Values::required_sum - partial_sum;
+
+      if (line.n_unfilled == 1) {
+        if (needed < 0 || needed >= 32 || !((available >> needed) & 1u))
+          return false;
+        continue;
+      }
+
+      uint32_t low_values = available;
+      uint32_t high_values = available;
+      int min_sum = 0;
+      int max_sum = 0;
+      for (size_t j = 0; j != line.n_unfilled; ++j) {
+        if (low_values == 0)
+          return false;
+        const int low = __builtin_ctz(low_values);
+        const int high = 31 - __builtin_clz(high_values);
+        min_sum += low;
+        max_sum += high;
+        low_values &= low_values - 1;
+        high_values &= ~(1u << high);
+      }
+      if (needed < min_sum || needed > max_sum)
+        return false;
+    }
+    return true;
+  }
+
+  template<RecursionStrategy RS, size_t Depth = 0>
+  void solve()
+  {
+    stats.count_node(Depth);
+
+    if constexpr (RangePrune && Depth != 0 && Depth != N_Hexes) {
+      if (!partial_lines_feasible<Depth - 1>()) {
+        stats.count_prune(Depth);
+        return;
+      }
+    }
+
+    if constexpr (Depth == N_Hexes) {
+      bool correct;
+      if constexpr (std::is_same_v<Lookup, LineSumsLookup>)
+        correct = lookup.all_lines_sum_to(Values::required_sum);
+      else
+        correct = spiral_solution_is_correct<Values::required_sum>(numbers);
+      if (correct)
+        consume_fun(numbers);
+      else
+        stats.count_prune(Depth);
+    }
+    else if constexpr (spiral_schedule[Depth].is_choice)
+      choose<RS, Depth>();
+    else
+      deduce<RS, Depth>();
+  }
+};
+
+/*
+  Iterative form of the "SwapAndSwapBack" array search.  Instead of
+  recursing, keep for each depth the range of slots still to be tried
+  there and the slot whose value was swapped in, so the whole search is
+  one loop over an explicit stack.  Candidates are tried in the same
+  order as the recursive search, so solutions come out in the same
+  order.  Depth is a run-time value here, so the lookup is a plain scan
+  driven by the schedule rather than a compile-time lookup policy.
+*/
+template<typename Consume, typename Stats = NoStats>
+struct IterativeArrayBoardStateT
+{
+  ArrUInt8 numbers;
+  Consume & consume_fun;
+  Stats stats;
+
+  // Next slot to try, and one past the last slot to try, at each depth.
+  std::array<size_t, N_Hexes> next_idx;
+  std::array<size_t, N_Hexes> end_idx;
+  // Slot swapped into each depth, to swap back on leaving it.
+  std::array<size_t, N_Hexes> placed_idx;
+
+  IterativeArrayBoardStateT(Consume & consume_fun, Stats stats = Stats{})
+    : numbers(ArrayBoardStateT<Consume>::initial_numbers())
+    , consume_fun(consume_fun)
+    , stats(stats)
+  {
+  }
+
+  size_t find_needed(size_t depth) const
+  {
+    const auto & step = spiral_schedule[depth];
+    uint8_t needed = Required_Sum;
+    for (size_t i = 0; i != step.n_have; ++i)
+      needed -= numbers[step.have_idxs[i]];
+
+    for (size_t i = depth; i != N_Hexes; ++i) {
+      if (numbers[i] == needed)
+        return i;
+    }
+    return N_Hexes;
+  }
+
+  void enter(size_t depth)
+  {
+    stats.count_node(depth);
+
+    if (spiral_schedule[depth].is_choice) {
+      next_idx[depth] = depth;
+      end_idx[depth] = N_Hexes;
+    } else {
+      const size_t maybe_needed_idx = find_needed(depth);
+      stats.count_deduction(depth, maybe_needed_idx != N_Hexes);
+      next_idx[depth] = maybe_needed_idx;
+      end_idx[depth] = std::min(maybe_needed_idx + 1, N_Hexes);
+    }
+  }
+
+  void set_numbers(const ArrUInt8 & new_numbers)
+  {
+    numbers = new_numbers;
+  }
+
+  // Search below a board whose first "start_depth" cells are filled.
+  // With "end_depth" less than N_Hexes, stop there instead, passing
+  // each board with "end_depth" cells filled to the sink unchecked
+  // (and uncounted, as searching below it will count it).
+  void solve(size_t start_depth = 0, size_t end_depth = N_Hexes)
+  {
+    size_t depth = start_depth;
+    enter(depth);
+
+    while (true) {
+      if (next_idx[depth] != end_idx[depth]) {
+        const size_t idx = next_idx[depth]++;
+        std::swap(numbers[depth], numbers[idx]);
+
+        if (depth + 1 == end_depth) {
+          if (end_depth != N_Hexes)
+            consume_fun(numbers);
+          else {
+            stats.count_node(N_Hexes);
+            if (spiral_solution_is_correct(numbers))
+              consume_fun(numbers);
+            else
+              stats.count_prune(N_Hexes);
+          }
+          std::swap(numbers[depth], numbers[idx]);
+        } else {
+          placed_idx[depth] = idx;
+          enter(++depth);
+        }
+      } else {
+        if (depth == start_depth)
+          return;
+        --depth;
+        std::swap(numbers[depth], numbers[placed_idx[depth]]);
+      }
+    }
+  }
+};
+
+/*
+  Simple work-stealing pool for a fixed set of independent tasks.  Each
+  worker is dealt a contiguous block of task indices; it works through
+  its own block from the front, and once that is empty it steals from
+  the back of other workers' blocks.  No tasks are created while the
+  pool is running, so a worker can stop as soon as every queue is empty.
+*/
+struct WorkStealingPool
+{
+  struct WorkerQueue
+  {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+  };
+
+  static size_t default_n_threads()
+  {
+    const size_t n_hw_threads = std::thread::hardware_concurrency();
+    return (n_hw_threads == 0) ? 1 : n_hw_threads;
+  }
+
+  static bool take_own(WorkerQueue & queue, size_t & task)
+  {
+    std::lock_guard<std::mutex> lock{queue.mutex};
+    if (queue.tasks.empty())
+      return false;
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+  }
+
+  static bool steal(WorkerQueue & queue, size_t & task)
+  {
+    std::lock_guard<std::mutex> lock{queue.mutex};
+    if (queue.tasks.empty())
+      return false;
+    task = queue.tasks.back();
+    queue.tasks.pop_back();
+    return true;
+  }
+
+  static void run(size_t n_tasks,
+                  const std::function<void(size_t)> & run_task,
+                  size_t n_threads = default_n_threads(),
+                  const std::atomic<bool> * stop_requested = nullptr)
+  {
+    n_threads = std::max<size_t>(1, std::min(n_threads, n_tasks));
+    std::vector<WorkerQueue> queues(n_threads);
+    for (size_t task = 0; task != n_tasks; ++task)
+      queues[task * n_threads / n_tasks].tasks.push_back(task);
+
+    auto work = [&](size_t self) {
+      size_t task;
+      while (stop_requested == nullptr || !*stop_requested) {
+        bool have_task = take_own(queues[self], task);
+        for (size_t i = 1; !have_task && i != n_threads; ++i)
+          have_task = steal(queues[(self + i) % n_threads], task);
+        if (!have_task)
+          return;
+        run_task(task);
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < n_threads; ++i)
+      threads.emplace_back(work, i);
+    work(0);
+    for (auto & thread : threads)
+      thread.join();
+  }
+};
+
+/*
+  Split the "deduce-array-swap" search tree after the first three choices
+  (cells 0, 1 and 3 in spiral order, with cell 2 deduced in between).
+  Prefixes are generated in the same order as the single-threaded search
+  visits them, so concatenating the per-prefix solutions reproduces its
+  output exactly.
+*/
+static const size_t Parallel_Split_Depth = 4;
+
+template<size_t Depth, typename StateT, typename Stats>
+void collect_array_board_prefixes(StateT & state,
+                                  std::vector<ArrUInt8> & prefixes,
+                                  Stats & stats)
+{
+  auto & numbers = state.numbers;
+  if constexpr (Depth == Parallel_Split_Depth)
+    prefixes.push_back(numbers);
+  else if constexpr (spiral_schedule[Depth].is_choice) {
+    stats.count_node(Depth);
+    for (size_t i = Depth; i != N_Hexes; ++i) {
+      std::swap(numbers[Depth], numbers[i]);
+      collect_array_board_prefixes<Depth + 1>(state, prefixes, stats);
+      std::swap(numbers[Depth], numbers[i]);
+    }
+  }
+  else {
+    stats.count_node(Depth);
+    const size_t i = state.template find_needed_from_schedule<Depth>();
+    stats.count_deduction(Depth, i != N_Hexes);
+    if (i != N_Hexes) {
+      std::swap(numbers[Depth], numbers[i]);
+      collect_array_board_prefixes<Depth + 1>(state, prefixes, stats);
+      std::swap(numbers[Depth], numbers[i]);
+    }
+  }
+}
+
+template<typename Stats = NoStats>
+std::vector<ArrUInt8> array_board_prefixes(Stats stats = Stats{})
+{
+  std::vector<ArrUInt8> prefixes;
+  IgnoreSink ignore_sink;
+  ArrayBoardStateT<IgnoreSink> state{ignore_sink};
+  collect_array_board_prefixes<0>(state, prefixes, stats);
+  return prefixes;
+}
+
+/*
+  If "n_wanted" is non-zero, no new prefixes are started once that many
+  solutions have been found between them.
+*/
+template<typename Consume, typename Stats = NoStats>
+void solve_array_swap_parallel(Consume & consume_fun,
+                               Stats stats = Stats{},
+                               size_t n_wanted = 0)
+{
+  const auto prefixes = array_board_prefixes(stats);
+
+  // One result slot per prefix; each is written by exactly one task,
+  // so no locking is needed while the pool runs.  The same goes for
+  // per-prefix counters, which are merged once the pool is done.
+  std::vector<CollectSink<ArrUInt8>> solutions(prefixes.size());
+  std::vector<DepthCounters> prefix_counters;
+  if constexpr (std::is_same_v<Stats, DepthStats>)
+    prefix_counters.assign(prefixes.size(), DepthCounters{N_Hexes});
+
+  std::atomic<size_t> n_found{0};
+  std::atomic<bool> have_enough{false};
+
+  WorkStealingPool::run(
+    prefixes.size(),
+    [&](size_t prefix_idx) {
+      Stats prefix_stats{stats};
+      if constexpr (std::is_same_v<Stats, DepthStats>)
+        prefix_stats.counters = &prefix_counters[prefix_idx];
+
+      ArrayBoardStateT<CollectSink<ArrUInt8>, ScanLookup, false, Stats> state{
+        solutions[prefix_idx], prefix_stats
+      };
+      state.set_numbers(prefixes[prefix_idx]);
+      state.template solve<RecursionStrategy::SwapAndSwapBack, Parallel_Split_Depth>();
+
+      const size_t n_prefix_solutions = solutions[prefix_idx].boards.size();
+      if (n_wanted != 0 && (n_found += n_prefix_solutions) >= n_wanted)
+        have_enough = true;
+    },
+    WorkStealingPool::default_n_threads(),
+    &have_enough);
+
+  if constexpr (std::is_same_v<Stats, DepthStats>)
+    for (const auto & counters : prefix_counters)
+      stats.counters->add(counters);
+
+  for (const auto & prefix_solutions : solutions)
+    for (const auto & board : prefix_solutions.boards)
+      consume_fun(board);
+}
+
+/*
+  The "deduce-array-swap" search laid out as a GPU would run it, on the
+  CPU cores: the host expands every prefix of "split_depth" cells, and
+  a kernel then searches below each prefix in a lane of its own, with
+  lanes launched in fixed-size blocks.  The kernel is the iterative
+  solver, so a lane needs no recursion and no allocation.  Lanes append
+  their solutions to one shared buffer through an atomic cursor; if the
+  buffer turns out too small the launch is repeated with the size the
+  cursor reached.  The host then orders the solutions by lane, which
+  restores the order of the single-threaded search.
+*/
+struct LaneSolution
+{
+  uint32_t lane;
+  ArrUInt8 board;
+};
+
+struct LaneSink
+{
+  uint32_t lane;
+  std::vector<LaneSolution> & results;
+  std::atomic<size_t> & n_results;
+
+  void operator()(const ArrUInt8 & board)
+  {
+    const size_t slot = n_results++;
+    if (slot < results.size())
+      results[slot] = LaneSolution{lane, board};
+  }
+};
+
+static const size_t Lanes_Per_Block = 256;
+
+template<typename Consume, typename Stats = NoStats>
+void solve_array_swap_lanes(Consume & consume_fun,
+                            size_t split_depth,
+                            Stats stats = Stats{})
+{
+  CollectSink<ArrUInt8> prefixes;
+  IterativeArrayBoardStateT<CollectSink<ArrUInt8>, Stats>{prefixes, stats}
+    .solve(0, split_depth);
+
+  const size_t n_lanes = prefixes.boards.size();
+  const size_t n_blocks = (n_lanes + Lanes_Per_Block - 1) / Lanes_Per_Block;
+  std::vector<LaneSolution> results(n_lanes);
+  std::atomic<size_t> n_results{0};
+  std::vector<DepthCounters> block_counters;
+
+  const auto launch = [&]() {
+    n_results = 0;
+    if constexpr (std::is_same_v<Stats, DepthStats>)
+      block_counters.assign(n_blocks, DepthCounters{N_Hexes});
+
+    WorkStealingPool::run(n_blocks, [&](size_t block_idx) {
+      Stats block_stats{stats};
+      if constexpr (std::is_same_v<Stats, DepthStats>)
+        block_stats.counters = &block_counters[block_idx];
+
+      const size_t lane_end = std::min(n_lanes, (block_idx + 1) * Lanes_Per_Block);
+      for (size_t lane = block_idx * Lanes_Per_Block; lane != lane_end; ++lane) {
+        LaneSink sink{static_cast<uint32_t>(lane), results, n_results};
+        IterativeArrayBoardStateT<LaneSink, Stats> state{sink, block_stats};
+        state.set_numbers(prefixes.boards[lane]);
+        state.solve(split_depth);
+      }
+    });
+  };
+
+  launch();
+  if (n_results > results.size()) {
+    results.resize(n_results);
+    launch();
+  }
+  results.resize(n_results);
+
+  if constexpr (std::is_same_v<Stats, DepthStats>)
+    for (const auto & counters : block_counters)
+      stats.counters->add(counters);
+
+  std::stable_sort(results.begin(), results.end(),
+                   [](const LaneSolution & a, const LaneSolution & b) {
+                     return a.lane < b.lane;
+                   });
+  for (const auto & result : results)
+    consume_fun(result.board);
+}
+
+/*
+  Permutations of 1..19 numbered from zero in the lexicographic order
+  next_permutation() visits them in.  19! is about 1.2e17, so ranks fit
+  in 64 bits.  Read as a factorial-base number, a rank's digits pick,
+  from most significant, which of the remaining values comes next.
+*/
+using PermRank = uint64_t;
+
+constexpr PermRank factorial(size_t n)
+{
+  return (n <= 1) ? 1 : n * factorial(n - 1);
+}
+
+static constexpr PermRank N_Permutations = factorial(N_Hexes);
+
+VecUInt8 unrank_permutation(PermRank rank)
+{
+  VecUInt8 remaining(N_Hexes);
+  std::iota(remaining.begin(), remaining.end(), 1);
+
+  VecUInt8 board;
+  board.reserve(N_Hexes);
+  for (size_t i = 0; i != N_Hexes; ++i) {
+    const PermRank place_value = factorial(N_Hexes - 1 - i);
+    const size_t digit = rank / place_value;
+    rank %= place_value;
+    board.push_back(remaining[digit]);
+    remaining.erase(remaining.begin() + digit);
+  }
+  return board;
+}
+
+/*
+  Brute-force check of the ranks [start_rank, start_rank + n_ranks),
+  cut into chunks of "chunk_n_ranks" which are run on all cores.  Each
+  worker takes the next chunk from a shared cursor, jumps to its first
+  permutation by unranking, then steps on with next_permutation().
+  Nothing is kept per chunk, so memory does not grow with the number of
+  chunks: solutions go into one shared list, tagged with their chunk,
+  and are passed on in rank order at the end.  Disjoint ranges can
+  equally be given to separate processes.  As for the parallel array
+  solver, with "n_wanted" set no new chunks are started once enough
+  solutions are found.
+*/
+template<typename Consume>
+void solve_std_perm_rank_range(Consume & consume_fun,
+                               PermRank start_rank,
+                               PermRank n_ranks,
+                               PermRank chunk_n_ranks,
+                               size_t n_wanted = 0)
+{
+  if (start_rank >= N_Permutations)
+    return;
+  n_ranks = std::min(n_ranks, N_Permutations - start_rank);
+  chunk_n_ranks = std::max<PermRank>(chunk_n_ranks, 1);
+  const PermRank n_chunks = (n_ranks + chunk_n_ranks - 1) / chunk_n_ranks;
+
+  std::mutex solutions_mutex;
+  std::vector<std::pair<PermRank, VecUInt8>> solutions;
+  std::atomic<PermRank> next_chunk{0};
+  std::atomic<size_t> n_found{0};
+  std::atomic<bool> have_enough{false};
+
+  const auto check_chunks = [&]() {
+    while (!have_enough) {
+      const PermRank chunk_idx = next_chunk++;
+      if (chunk_idx >= n_chunks)
+        return;
+
+      const PermRank chunk_start = start_rank + chunk_idx * chunk_n_ranks;
+      const PermRank chunk_end = std::min(chunk_start + chunk_n_ranks,
+                                          start_rank + n_ranks);
+      VecUInt8 board = unrank_permutation(chunk_start);
+      size_t n_chunk_solutions = 0;
+      for (PermRank rank = chunk_start; rank != chunk_end; ++rank) {
+        if (raster_solution_is_correct(board)) {
+          std::lock_guard<std::mutex> lock{solutions_mutex};
+          solutions.emplace_back(chunk_idx, board);
+          ++n_chunk_solutions;
+        }
+        std::next_permutation(board.begin(), board.end());
+      }
+
+      if (n_wanted != 0 && (n_found += n_chunk_solutions) >= n_wanted)
+        have_enough = true;
+    }
+  };
+
+  const size_t n_threads = static_cast<size_t>(std::min<PermRank>(
+    WorkStealingPool::default_n_threads(), n_chunks));
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < n_threads; ++i)
+    workers.emplace_back(check_chunks);
+  check_chunks();
+  for (auto & worker : workers)
+    worker.join();
+
+  std::stable_sort(solutions.begin(), solutions.end(),
+                   [](const auto & a, const auto & b) { return a.first < b.first; });
+  for (const auto & solution : solutions)
+    consume_fun(solution.second);
+}
+
+/*
+  Geometry and solve plan for a magic hexagon of any order, where the
+  order is the number of cells along each edge.  Cells are located by
+  cube coordinates (x, y, z) with x + y + z = 0, where y picks the row
+  and every coordinate lies in [-R, R] for R = order - 1.  Cells are
+  numbered in raster order as above, and lines are listed in the same
+  order as "hex_lines": rows, then the lines of constant z, then the
+  lines of constant x.  For order 3 this reproduces "hex_lines" and the
+  spiral order exactly.
+*/
+struct HexGeometry
+{
+  size_t order;
+  size_t n_cells;
+  std::vector<std::vector<size_t>> lines;
+  std::vector<size_t> spiral_order;
+
+  static int radius(size_t order) { return static_cast<int>(order) - 1; }
+  static size_t n_cells_of_order(size_t order) { return 3 * order * (order - 1) + 1; }
+
+  int row_x_min(int y) const { return std::max(-radius(order), -radius(order) - y); }
+  int row_x_max(int y) const { return std::min(radius(order), radius(order) - y); }
+
+  size_t raster_index(int x, int y) const
+  {
+    const int R = radius(order);
+    size_t idx = 0;
+    for (int row = -R; row != y; ++row)
+      idx += row_x_max(row) - row_x_min(row) + 1;
+    return idx + (x - row_x_min(y));
+  }
+
+  explicit HexGeometry(size_t order)
+    : order(order)
+    , n_cells(n_cells_of_order(order))
+  {
+    const int R = radius(order);
+
+    for (int y = -R; y <= R; ++y) {
+      std::vector<size_t> line;
+      for (int x = row_x_min(y); x <= row_x_max(y); ++x)
+        line.push_back(raster_index(x, y));
+      lines.push_back(line);
+    }
+
+    for (int z = R; z >= -R; --z) {
+      std::vector<size_t> line;
+      for (int y = -R; y <= R; ++y) {
+        const int x = -y - z;
+        if (x >= row_x_min(y) && x <= row_x_max(y))
+          line.push_back(raster_index(x, y));
+      }
+      lines.push_back(line);
+    }
+
+    for (int x = R; x >= -R; --x) {
+      std::vector<size_t> line;
+      for (int y = -R; y <= R; ++y)
+        if (x >= row_x_min(y) && x <= row_x_max(y))
+          line.push_back(raster_index(x, y));
+      lines.push_back(line);
+    }
+
+    // Inwards spiral: each ring starts at its top-left corner and runs
+    // clockwise, k steps along each of the six edges of ring k.
+    static const int ring_steps[6][2] = {
+      {1, 0}, {0, 1}, {-1, 1}, {-1, 0}, {0, -1}, {1, -1}
+    };
+    for (int k = R; k > 0; --k) {
+      int x = 0, y = -k;
+      for (const auto & step : ring_steps) {
+        for (int i = 0; i != k; ++i) {
+          spiral_order.push_back(raster_index(x, y));
+          x += step[0];
+          y += step[1];
+        }
+      }
+    }
+    spiral_order.push_back(raster_index(0, 0));
+  }
+
+  // Values 1..n_cells, split between the (2 * order - 1) rows.
+  bool has_integer_magic_sum() const
+  {
+    return (n_cells * (n_cells + 1) / 2) % lines_per_direction() == 0;
+  }
+
+  int magic_sum() const
+  {
+    return static_cast<int>(n_cells * (n_cells + 1) / 2 / lines_per_direction());
+  }
+
+  size_t lines_per_direction() const { return 2 * order - 1; }
+};
+
+/*
+  A plan says, for each step of filling the board in a given order,
+  whether to choose the next cell's value freely or to deduce it from
+  the cells already filled in one of its lines.  Any further lines
+  completed by that cell are checked straight away, so once the board
+  is full every line is known to be correct.  All cell indices in the
+  plan are positions in the fill order, which is also the order in
+  which the solver stores the cell values.  "values" is the pool of
+  values to place, 1..n_cells by default.  It may have repeats, and may
+  be larger than the board, in which case the unused values are left
+  after the board's cells.
+*/
+struct SolvePlanStep
+{
+  // A line of one cell deduces that cell from no others, so whether a
+  // step is a deduction is kept separately from "deduce_from".
+  bool deduced = false;
+  std::vector<size_t> deduce_from;
+  std::vector<std::vector<size_t>> check_lines;
+
+  bool is_choice() const { return !deduced; }
+};
+
+struct SolvePlan
+{
+  size_t n_cells;
+  int required_sum;
+  std::vector<size_t> fill_order;
+  std::vector<SolvePlanStep> steps;
+  VecUInt8 values;
+  bool has_repeated_values;
+
+  SolvePlan(const HexGeometry & geometry,
+            const std::vector<size_t> & fill_order,
+            int required_sum,
+            const VecUInt8 & pool = {})
+    : n_cells(geometry.n_cells)
+    , required_sum(required_sum)
+    , fill_order(fill_order)
+    , steps(geometry.n_cells)
+    , values(pool)
+  {
+    if (values.empty()) {
+      values.resize(n_cells);
+      std::iota(values.begin(), values.end(), 1);
+    }
+    VecUInt8 sorted_values{values};
+    std::sort(sorted_values.begin(), sorted_values.end());
+    has_repeated_values = (std::adjacent_find(sorted_values.begin(), sorted_values.end())
+                           != sorted_values.end());
+
+    std::vector<size_t> position_of_cell(n_cells);
+    for (size_t pos = 0; pos != n_cells; ++pos)
+      position_of_cell[fill_order[pos]] = pos;
+
+    for (const auto & line : geometry.lines) {
+      std::vector<size_t> positions;
+      for (const auto cell : line)
+        positions.push_back(position_of_cell[cell]);
+      std::sort(positions.begin(), positions.end());
+
+      const size_t last_pos = positions.back();
+      positions.pop_back();
+      auto & step = steps[last_pos];
+      if (step.is_choice()) {
+        step.deduced = true;
+        step.deduce_from = positions;
+      } else {
+        positions.push_back(last_pos);
+        step.check_lines.push_back(positions);
+      }
+    }
+  }
+};
+
+/*
+  Geometries and plans, built once each and shared by every search
+  which asks for the same one, so that jobs run by "batch" do not
+  repeat the setup.  Entries are never removed, so references stay
+  valid for the life of the process.
+*/
+const HexGeometry & shared_geometry(size_t order)
+{
+  static std::map<size_t, HexGeometry> geometries;
+  auto found = geometries.find(order);
+  if (found == geometries.end())
+    found = geometries.emplace(order, HexGeometry{order}).first;
+  return found->second;
+}
+
+const SolvePlan & shared_solve_plan(const HexGeometry & geometry,
+                                    const std::vector<size_t> & fill_order,
+                                    int required_sum,
+                                    const VecUInt8 & pool)
+{
+  using Key = std::tuple<size_t, std::vector<size_t>, int, VecUInt8>;
+  static std::map<Key, SolvePlan> plans;
+  Key key{geometry.order, fill_order, required_sum, pool};
+  auto found = plans.find(key);
+  if (found == plans.end())
+    found = plans.emplace(key, SolvePlan{geometry, fill_order, required_sum, pool}).first;
+  return found->second;
+}
+
+/*
+  Once "depth" cells of a plan are filled, what happens below depends
+  only on which values are left and, through the lines with cells on
+  both sides of "depth", on the sums of those lines' filled cells:
+  every line lying wholly in the first "depth" cells has already been
+  checked.  Different prefixes often agree on all of that, so
+  "PlannedTailTable" remembers, for each such key, the values the
+  search put in the remaining slots of each solution below it.  The
+  table is a fixed number of slots, each holding one key, and a new key
+  takes over its slot regardless of what was there.  Keys with more
+  than "Max_Tails" solutions below them are not stored.
+*/
+struct PlannedTailTable
+{
+  static constexpr size_t Max_Tails = 4;
+  using Key = std::vector<int>;
+
+  struct Entry
+  {
+    bool used = false;
+    Key key;
+    std::vector<VecUInt8> tails;
+  };
+
+  size_t depth;
+  std::vector<std::vector<size_t>> key_lines;
+  std::vector<Entry> entries;
+  size_t n_lookups = 0;
+  size_t n_hits = 0;
+  size_t n_stores = 0;
+  size_t n_replaced = 0;
+  size_t n_not_stored = 0;
+
+  // The number of slots is rounded up to a power of two.
+  PlannedTailTable(const SolvePlan & plan, size_t depth, size_t n_entries)
+    : depth(depth)
+  {
+    for (size_t pos = depth; pos != plan.n_cells; ++pos) {
+      const auto & step = plan.steps[pos];
+      if (!step.is_choice())
+        add_key_line(step.deduce_from);
+      for (const auto & line : step.check_lines)
+        add_key_line(line);
+    }
+
+    size_t n_slots = 1;
+    while (n_slots < n_entries)
+      n_slots *= 2;
+    entries.resize(n_slots);
+  }
+
+  void add_key_line(const std::vector<size_t> & line)
+  {
+    std::vector<size_t> filled;
+    for (const auto pos : line)
+      if (pos < depth)
+        filled.push_back(pos);
+    if (!filled.empty())
+      key_lines.push_back(filled);
+  }
+
+  void make_key(const VecUInt8 & numbers, Key & key) const
+  {
+    key.assign(numbers.begin() + depth, numbers.end());
+    std::sort(key.begin(), key.end());
+    for (const auto & line : key_lines) {
+      int sum = 0;
+      for (const auto pos : line)
+        sum += numbers[pos];
+      key.push_back(sum);
+    }
+  }
+
+  Entry & slot(const Key & key)
+  {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const auto k : key)
+      h = (h ^ static_cast<uint64_t>(k)) * 0x100000001b3ull;
+    return entries[(h ^ (h >> 29)) & (entries.size() - 1)];
+  }
+
+  const Entry * find(const Key & key)
+  {
+    ++n_lookups;
+    const Entry & entry = slot(key);
+    const bool hit = (entry.used && entry.key == key);
+    n_hits += hit;
+    return hit ? &entry : nullptr;
+  }
+
+  void store(const Key & key, const std::vector<VecUInt8> & tails)
+  {
+    if (tails.size() > Max_Tails) {
+      ++n_not_stored;
+      return;
+    }
+    Entry & entry = slot(key);
+    n_replaced += entry.used;
+    ++n_stores;
+    entry.used = true;
+    entry.key = key;
+    entry.tails = tails;
+  }
+
+  void print() const
+  {
+    std::cout << "MEMO: depth " << depth
+              << " slots " << entries.size()
+              << " lookups " << n_lookups
+              << " hits " << n_hits
+              << " hit_rate " << (n_lookups == 0 ? 0.0
+                                  : static_cast<double>(n_hits) / n_lookups)
+              << " stores " << n_stores
+              << " replaced " << n_replaced
+              << " not_stored " << n_not_stored << "\n";
+  }
+};
+
+template<typename Consume, typename Stats = NoStats>
+struct PlannedBoardStateT
+{
+  const SolvePlan & plan;
+  VecUInt8 numbers;
+  size_t n_cells_filled;
+  Consume & consume_fun;
+  Stats stats;
+
+  // With "memo" set, the search below depth "memo->depth" goes through
+  // it, recording the tails of the solutions it finds in "memo_tails".
+  PlannedTailTable * memo;
+  PlannedTailTable::Key memo_key;
+  std::vector<VecUInt8> memo_tails;
+  bool recording_tails = false;
+  VecUInt8 memo_board;
+
+  PlannedBoardStateT(const SolvePlan & plan,
+                     Consume & consume_fun,
+                     Stats stats = Stats{},
+                     PlannedTailTable * memo = nullptr)
+    : plan(plan)
+    , numbers(plan.values)
+    , n_cells_filled(0)
+    , consume_fun(consume_fun)
+    , stats(stats)
+    , memo(memo)
+  {
+  }
+
+  bool lines_correct(const SolvePlanStep & step) const
+  {
+    for (const auto & line : step.check_lines) {
+      int sum = 0;
+      for (const auto pos : line)
+        sum += numbers[pos];
+      if (sum != plan.required_sum)
+        return false;
+    }
+    return true;
+  }
+
+  void fill_from_idx(const SolvePlanStep & step, size_t idx)
+  {
+    std::swap(numbers[n_cells_filled], numbers[idx]);
+    ++n_cells_filled;
+    if (lines_correct(step))
+      solve();
+    else
+      stats.count_prune(n_cells_filled - 1);
+    --n_cells_filled;
+    std::swap(numbers[n_cells_filled], numbers[idx]);
+  }
+
+  void choose(const SolvePlanStep & step)
+  {
+    if (!plan.has_repeated_values) {
+      for (size_t i = n_cells_filled; i != numbers.size(); ++i)
+        fill_from_idx(step, i);
+      return;
+    }
+
+    // Equal values give identical sub-searches, so try each only once.
+    std::array<bool, 256> tried{};
+    for (size_t i = n_cells_filled; i != numbers.size(); ++i) {
+      if (!tried[numbers[i]]) {
+        tried[numbers[i]] = true;
+        fill_from_idx(step, i);
+      }
+    }
+  }
+
+  void deduce(const SolvePlanStep & step)
+  {
+    int needed = plan.required_sum;
+    for (const auto pos : step.deduce_from)
+      needed -= numbers[pos];
+
+    for (size_t i = n_cells_filled; i != numbers.size(); ++i) {
+      if (numbers[i] == needed) {
+        stats.count_deduction(n_cells_filled, true);
+        fill_from_idx(step, i);
+        return;
+      }
+    }
+    stats.count_deduction(n_cells_filled, false);
+  }
+
+  void solve()
+  {
+    stats.count_node(n_cells_filled);
+
+    // Any values beyond the board's cells are unused ones.
+    if (n_cells_filled == plan.n_cells) {
+      if (recording_tails && memo_tails.size() <= PlannedTailTable::Max_Tails)
+        memo_tails.emplace_back(numbers.begin() + memo->depth, numbers.end());
+      consume_fun(numbers);
+      return;
+    }
+
+    if (memo != nullptr && n_cells_filled == memo->depth)
+      solve_memoised();
+    else
+      explore();
+  }
+
+  void explore()
+  {
+    const auto & step = plan.steps[n_cells_filled];
+    if (step.is_choice())
+      choose(step);
+    else
+      deduce(step);
+  }
+
+  // No key is made below "memo->depth", so "memo_key" holds throughout
+  // the search below this position.
+  void solve_memoised()
+  {
+    memo->make_key(numbers, memo_key);
+    if (const auto * entry = memo->find(memo_key)) {
+      memo_board = numbers;
+      for (const auto & tail : entry->tails) {
+        std::copy(tail.begin(), tail.end(), memo_board.begin() + memo->depth);
+        consume_fun(memo_board);
+      }
+      return;
+    }
+
+    memo_tails.clear();
+    recording_tails = true;
+    explore();
+    recording_tails = false;
+    memo->store(memo_key, memo_tails);
+  }
+};
+
+/*
+  Search for a fill order which keeps the "deduce" search tree small.
+  A beam search builds orders one cell at a time, scoring each partial
+  order by its predicted node count.  Treating cell values as
+  independent and uniform over 1..N, a chosen cell multiplies the number
+  of live branches by the number of values still available, r.  A cell
+  deduced from a line with k other cells multiplies it by the chance
+  that those k values leave a needed value in 1..N, times r / N for that
+  value still being available.  Each further line completed by the same
+  cell multiplies it by the chance that the line has the right sum.
+  The future of a partial order depends only on which cells it has
+  filled, so of the partial orders with the same cells and the same
+  most recent cell, only the best is kept.  The most promising complete
+  orders are then measured by running the plan-driven solver.
+*/
+struct FillOrderCandidate
+{
+  std::vector<size_t> fill_order;
+  std::vector<bool> is_filled;
+  double n_live_branches;
+  double predicted_n_nodes;
+
+  bool operator<(const FillOrderCandidate & rhs) const
+  {
+    if (predicted_n_nodes != rhs.predicted_n_nodes)
+      return predicted_n_nodes < rhs.predicted_n_nodes;
+    return fill_order < rhs.fill_order;
+  }
+};
+
+struct FillOrderOptimiser
+{
+  const HexGeometry & geometry;
+  std::vector<std::vector<size_t>> lines_of_cell;
+  std::vector<double> p_deduction_in_range;
+  std::vector<double> p_line_correct;
+
+  explicit FillOrderOptimiser(const HexGeometry & geometry)
+    : geometry(geometry)
+    , lines_of_cell(geometry.n_cells)
+  {
+    for (size_t line_idx = 0; line_idx != geometry.lines.size(); ++line_idx)
+      for (const auto cell : geometry.lines[line_idx])
+        lines_of_cell[cell].push_back(line_idx);
+
+    // p_sum[s] is the chance that k independent uniform values sum to s,
+    // built up one value at a time for k = 0, 1, ..., longest line.
+    const int n_values = geometry.n_cells;
+    const int target = geometry.magic_sum();
+    std::vector<double> p_sum{1.0};
+    for (size_t k = 0; k != 2 * geometry.order; ++k) {
+      double p_in_range = 0.0;
+      for (int v = 1; v <= n_values; ++v)
+        if (target - v >= 0 && target - v < static_cast<int>(p_sum.size()))
+          p_in_range += p_sum[target - v];
+      p_deduction_in_range.push_back(p_in_range);
+      p_line_correct.push_back(target < static_cast<int>(p_sum.size())
+                               ? p_sum[target] : 0.0);
+
+      std::vector<double> next_p_sum(p_sum.size() + n_values, 0.0);
+      for (size_t s = 0; s != p_sum.size(); ++s)
+        for (int v = 1; v <= n_values; ++v)
+          next_p_sum[s + v] += p_sum[s] / n_values;
+      p_sum = next_p_sum;
+    }
+  }
+
+  FillOrderCandidate extended(const FillOrderCandidate & candidate, size_t cell) const
+  {
+    const double n_values = geometry.n_cells;
+    const double n_available = n_values - candidate.fill_order.size();
+
+    double branching = n_available;
+    bool have_deduced = false;
+    for (const auto line_idx : lines_of_cell[cell]) {
+      const auto & line = geometry.lines[line_idx];
+      const bool completes_line = std::all_of(
+        line.begin(), line.end(),
+        [&](size_t other) { return other == cell || candidate.is_filled[other]; });
+      if (!completes_line)
+        continue;
+
+      if (!have_deduced) {
+        branching = p_deduction_in_range[line.size() - 1] * n_available / n_values;
+        have_deduced = true;
+      }
+      else
+        branching *= p_line_correct[line.size()];
+    }
+
+    FillOrderCandidate child{candidate};
+    child.fill_order.push_back(cell);
+    child.is_filled[cell] = true;
+    child.n_live_branches *= branching;
+    child.predicted_n_nodes += child.n_live_branches;
+    return child;
+  }
+
+  double predicted_n_nodes(const std::vector<size_t> & fill_order) const
+  {
+    FillOrderCandidate candidate{{}, std::vector<bool>(geometry.n_cells), 1.0, 1.0};
+    for (const auto cell : fill_order)
+      candidate = extended(candidate, cell);
+    return candidate.predicted_n_nodes;
+  }
+
+  std::vector<FillOrderCandidate> beam_search(size_t beam_width) const
+  {
+    std::vector<FillOrderCandidate> beam{
+      {{}, std::vector<bool>(geometry.n_cells), 1.0, 1.0}
+    };
+
+    for (size_t depth = 0; depth != geometry.n_cells; ++depth) {
+      std::map<std::pair<std::vector<bool>, size_t>, FillOrderCandidate> best_by_cells;
+      for (const auto & candidate : beam) {
+        for (size_t cell = 0; cell != geometry.n_cells; ++cell) {
+          if (candidate.is_filled[cell])
+            continue;
+          auto child = extended(candidate, cell);
+          const auto key = std::make_pair(child.is_filled, cell);
+          auto existing = best_by_cells.find(key);
+          if (existing == best_by_cells.end())
+            best_by_cells.emplace(key, std::move(child));
+          else if (child < existing->second)
+            existing->second = std::move(child);
+        }
+      }
+
+      beam.clear();
+      for (auto & entry : best_by_cells)
+        beam.push_back(std::move(entry.second));
+      std::sort(beam.begin(), beam.end());
+      if (beam.size() > beam_width)
+        beam.resize(beam_width);
+    }
+
+    return beam;
+  }
+};
+
+size_t measured_n_nodes(const HexGeometry & geometry,
+                        const std::vector<size_t> & fill_order)
+{
+  const SolvePlan plan{geometry, fill_order, geometry.magic_sum()};
+  DepthCounters counters{geometry.n_cells};
+  IgnoreSink ignore_sink;
+  PlannedBoardStateT<IgnoreSink, DepthStats>{plan, ignore_sink, {&counters}}.solve();
+  return counters.total_n_nodes();
+}
+
+bool is_valid_fill_order(const HexGeometry & geometry,
+                         const std::vector<size_t> & fill_order)
+{
+  std::vector<size_t> sorted_order{fill_order};
+  std::sort(sorted_order.begin(), sorted_order.end());
+  std::vector<size_t> all_cells(geometry.n_cells);
+  std::iota(all_cells.begin(), all_cells.end(), 0);
+  return sorted_order == all_cells;
+}
+
+std::string fill_order_arg(const std::vector<size_t> & fill_order)
+{
+  std::ostringstream arg;
+  for (size_t i = 0; i != fill_order.size(); ++i)
+    arg << (i == 0 ? "" : ",") << fill_order[i];
+  return arg.str();
+}
+
+/*
+  Run the final, reported, search of a strategy.  "run" is given the
+  sink to report solutions to, and "DepthStats" if "--stats" was given
+  or "NoStats" otherwise.  With "--perf", the hardware counters cover
+  just this search, not the untimed repeats before it.  Afterwards
+  print the per-depth profile and the counters (even if the search
+  bailed out), and the count or existence of solutions if asked for.
+*/
+template<typename RunFun>
+void run_reported_search(size_t n_cells, RunFun run)
+{
+  ReportSink sink{
+    !options.count_only && !options.exists_only,
+    options.exists_only ? 1 : options.n_solutions_wanted,
+    VecUInt8(n_cells)
+  };
+  DepthCounters counters{n_cells};
+
+  std::unique_ptr<BinarySolutionWriter> binary_out;
+  if (!options.binary_output_path.empty() && sink.print_solutions) {
+    binary_out = std::make_unique<BinarySolutionWriter>(
+      options.binary_output_path,
+      n_cells,
+      (options.values.empty()
+       ? n_cells
+       : *std::max_element(options.values.begin(), options.values.end())),
+      CellOrdering::Raster);
+    sink.binary_out = binary_out.get();
+  }
+
+  std::unique_ptr<SolutionPipeline> pipeline;
+  if (options.async_queue_size != 0 && sink.print_solutions) {
+    pipeline = std::make_unique<SolutionPipeline>(
+      n_cells, options.async_queue_size, binary_out.get());
+    sink.pipeline = pipeline.get();
+  }
+
+  std::unique_ptr<PerfCounters> perf;
+  if (options.perf_counters)
+    perf = std::make_unique<PerfCounters>();
+
+  try {
+    try {
+      if (perf)
+        perf->start();
+      if (options.collect_stats)
+        run(sink, DepthStats{&counters});
+      else
+        run(sink, NoStats{});
+    } catch (const SearchStopped &) {
+      search_stopped_early = true;
+    }
+  } catch (const SearchBailed &) {
+    if (perf)
+      perf->stop();
+    if (pipeline) {
+      pipeline->finish();
+      pipeline->print_stats();
+    }
+    if (options.collect_stats)
+      counters.print();
+    if (perf)
+      perf->print();
+    throw;
+  }
+
+  if (perf)
+    perf->stop();
+  if (pipeline) {
+    pipeline->finish();
+    pipeline->print_stats();
+  }
+  if (options.collect_stats)
+    counters.print();
+  if (perf)
+    perf->print();
+  if (options.exists_only)
+    std::cout << "EXISTS: " << (sink.n_solutions != 0 ? "yes" : "no") << "\n";
+  else if (options.count_only)
+    std::cout << "COUNT: " << sink.n_solutions << "\n";
+}
+
+template<typename Check>
+void solve_manual_perm()
+{
+  set_attempt_limits(10000000, 100000000);
+
+  run_reported_search(N_Hexes, [](auto & sink, auto stats) {
+    using Sink = std::remove_reference_t<decltype(sink)>;
+    if (options.pool_allocator)
+      BoardStateT<Sink, decltype(stats), PoolVecUInt8>{sink, stats}
+        .template solve_check_when_full<Check>();
+    else
+      BoardStateT<Sink, decltype(stats)>{sink, stats}
+        .template solve_check_when_full<Check>();
+  });
+}
+
+template<typename Check>
+void solve_std_perm()
+{
+  set_attempt_limits(250000000, 2500000000);
+
+  run_reported_search(N_Hexes, [](auto & sink, auto /* stats */) {
+    VecUInt8 board(N_Hexes);
+    std::iota(board.begin(), board.end(), 1);
+    if (!resume_board.empty()) {
+      board = resume_board;
+      resume_board.clear();
+    }
+
+    while (true) {
+      if (Check::is_solution(board))
+        sink(board);
+      if ( ! std::next_permutation(board.begin(), board.end()))
+        break;
+    }
+  });
+}
+
+void solve_std_perm_batched()
+{
+  set_attempt_limits(250000000, 2500000000);
+
+  run_reported_search(N_Hexes, [](auto & sink, auto /* stats */) {
+    using Sink = std::remove_reference_t<decltype(sink)>;
+    BatchedCheck<Sink> check{sink};
+    VecUInt8 board(N_Hexes);
+    std::iota(board.begin(), board.end(), 1);
+
+    while (true) {
+      check.add(board);
+      if ( ! std::next_permutation(board.begin(), board.end()))
+        break;
+    }
+    check.flush();
+  });
+}
+
+void solve_std_perm_parallel()
+{
+  run_reported_search(N_Hexes, [](auto & sink, auto /* stats */) {
+    solve_std_perm_rank_range(sink,
+                              options.start_rank,
+                              options.n_ranks,
+                              options.chunk_n_ranks,
+                              sink.n_wanted);
+  });
+}
+
+template<FillOrder FO>
+void solve_test_line_by_line()
+{
+  run_reported_search(N_Hexes, [](auto & sink, auto stats) {
+    using Sink = std::remove_reference_t<decltype(sink)>;
+    if (options.pool_allocator)
+      BoardStateT<Sink, decltype(stats), PoolVecUInt8>{sink, stats}
+        .template solve_test_as_lines_filled<FO>();
+    else
+      BoardStateT<Sink, decltype(stats)>{sink, stats}
+        .template solve_test_as_lines_filled<FO>();
+  });
+}
+
+void solve_deduce_last_cell_of_line()
+{
+  IgnoreSink ignore_sink;
+  for (size_t i = 0; i != n_quiet_repeats; ++i)
+    PackedBoardStateT<IgnoreSink>{ignore_sink}.solve();
+
+  run_reported_search(N_Hexes, [](auto & sink, auto stats) {
+    using Sink = std::remove_reference_t<decltype(sink)>;
+    PackedBoardStateT<Sink, decltype(stats)>{sink, stats}.solve();
+  });
+}
+
+template<RecursionStrategy RS, typename Lookup = ScanLookup, bool RangePrune = false>
 void solve_deduce_last_cell_of_line_array()
 {
-  for (size_t i = 0; i != 99; ++i)
-    ArrayBoardState{ignore<ArrUInt8>}.solve<RS>();
+  IgnoreSink ignore_sink;
+  for (size_t i = 0; i != n_quiet_repeats; ++i)
+    ArrayBoardStateT<IgnoreSink, Lookup, false, NoStats, StandardValues, RangePrune>{
+      ignore_sink
+    }.template solve<RS>();
+
+  run_reported_search(N_Hexes, [](auto & sink, auto stats) {
+    using Sink = std::remove_reference_t<decltype(sink)>;
+    ArrayBoardStateT<Sink, Lookup, false, decltype(stats), StandardValues, RangePrune>{
+      sink, stats
+    }.template solve<RS>();
+  });
+}
+
+template<typename Lookup = ScanLookup>
+void solve_deduce_last_cell_of_line_array_canonical()
+{
+  constexpr auto RS = RecursionStrategy::SwapAndSwapBack;
+
+  IgnoreSink ignore_sink;
+  for (size_t i = 0; i != n_quiet_repeats; ++i)
+    ArrayBoardStateT<IgnoreSink, Lookup, true>{ignore_sink}.template solve<RS>();
+
+  run_reported_search(N_Hexes, [](auto & sink, auto stats) {
+    using Sink = std::remove_reference_t<decltype(sink)>;
+    using Stats = decltype(stats);
+    if (options.expand_symmetries) {
+      AllSymmetriesSink<Sink> all_symmetries_sink{sink};
+      ArrayBoardStateT<AllSymmetriesSink<Sink>, Lookup, true, Stats>{
+        all_symmetries_sink, stats
+      }.template solve<RS>();
+    }
+    else
+      ArrayBoardStateT<Sink, Lookup, true, Stats>{sink, stats}
+        .template solve<RS>();
+  });
+}
+
+void solve_deduce_last_cell_of_line_array_iterative()
+{
+  IgnoreSink ignore_sink;
+  for (size_t i = 0; i != n_quiet_repeats; ++i)
+    IterativeArrayBoardStateT<IgnoreSink>{ignore_sink}.solve();
+
+  run_reported_search(N_Hexes, [](auto & sink, auto stats) {
+    using Sink = std::remove_reference_t<decltype(sink)>;
+    IterativeArrayBoardStateT<Sink, decltype(stats)>{sink, stats}.solve();
+  });
+}
+
+void solve_deduce_last_cell_of_line_array_lanes()
+{
+  IgnoreSink ignore_sink;
+  for (size_t i = 0; i != n_quiet_repeats; ++i)
+    solve_array_swap_lanes(ignore_sink, options.split_depth);
+
+  run_reported_search(N_Hexes, [](auto & sink, auto stats) {
+    solve_array_swap_lanes(sink, options.split_depth, stats);
+  });
+}
+
+void solve_deduce_last_cell_of_line_array_parallel()
+{
+  IgnoreSink ignore_sink;
+  for (size_t i = 0; i != n_quiet_repeats; ++i)
+    solve_array_swap_parallel(ignore_sink);
+
+  run_reported_search(N_Hexes, [](auto & sink, auto stats) {
+    solve_array_swap_parallel(sink, stats, sink.n_wanted);
+  });
+}
+
+/*
+  If the configuration matches one of "Precompiled_Value_Sets", run the
+  array solver built for it instead of the generic engine, returning
+  whether it did.
+*/
+template<typename Values, typename Sink, typename Stats>
+bool run_precompiled_value_set(const VecUInt8 & sorted_values, int required_sum,
+                               Sink & sink, Stats stats)
+{
+  const ArrUInt8 values = Values::values();
+  if (required_sum != Values::required_sum
+      || !std::equal(values.begin(), values.end(),
+                     sorted_values.begin(), sorted_values.end()))
+    return false;
+
+  output_raster_index.assign(std::begin(spiral_to_raster), std::end(spiral_to_raster));
+  ArrayBoardStateT<Sink, ScanLookup, false, Stats, Values>{sink, stats}
+    .template solve<RecursionStrategy::SwapAndSwapBack>();
+  return true;
+}
+
+template<typename Sink, typename Stats, typename... ValueSets>
+bool run_precompiled(std::tuple<ValueSets...> *,
+                     const VecUInt8 & sorted_values, int required_sum,
+                     Sink & sink, Stats stats)
+{
+  return (run_precompiled_value_set<ValueSets>(sorted_values, required_sum, sink, stats)
+          || ...);
+}
+
+// A configuration which cannot be searched is an "invalid_argument",
+// which "run_strategy" reports as a failure.
+void solve_deduce_generic()
+{
+  const HexGeometry & geometry = shared_geometry(options.order);
+  const int n_rows = static_cast<int>(geometry.lines_per_direction());
+
+  VecUInt8 values{options.values};
+  if (values.empty()) {
+    values.resize(geometry.n_cells);
+    std::iota(values.begin(), values.end(), 1);
+  }
+  VecUInt8 sorted_values{values};
+  std::sort(sorted_values.begin(), sorted_values.end());
+  if (values.size() < geometry.n_cells) {
+    throw std::invalid_argument("need at least " + std::to_string(geometry.n_cells)
+                                + " values");
+  }
+
+  const auto & fill_order = (options.fill_order.empty()
+                             ? geometry.spiral_order
+                             : options.fill_order);
+  if (!is_valid_fill_order(geometry, fill_order)) {
+    throw std::invalid_argument("fill order must list each of the cells 0.."
+                                + std::to_string(geometry.n_cells - 1)
+                                + " exactly once");
+  }
+
+  // Every row uses each value in the board once, so the magic sum is
+  // the board's total divided by the number of rows.
+  const int min_total = std::accumulate(sorted_values.begin(),
+                                        sorted_values.begin() + geometry.n_cells, 0);
+  const int max_total = std::accumulate(sorted_values.end() - geometry.n_cells,
+                                        sorted_values.end(), 0);
+  std::vector<int> sums;
+  if (options.all_sums) {
+    for (int sum = (min_total + n_rows - 1) / n_rows; sum * n_rows <= max_total; ++sum)
+      sums.push_back(sum);
+  }
+  else if (options.required_sum >= 0)
+    sums.push_back(options.required_sum);
+  else if (values.size() != geometry.n_cells) {
+    throw std::invalid_argument("give \"--sum\" or \"--all-sums\" when there are"
+                                " more values than cells");
+  }
+  else if (min_total % n_rows != 0) {
+    std::cout << "No solutions: the values total " << min_total
+              << ", which cannot be split equally between "
+              << n_rows << " rows\n";
+    run_reported_search(geometry.n_cells, [](auto & /* sink */, auto /* stats */) {});
+    return;
+  }
+  else
+    sums.push_back(min_total / n_rows);
+
+  // By default the table covers the search once the outer ring's worth
+  // of cells is filled; any depth gives the same solutions.
+  const bool use_memo = (options.memo_n_entries != 0);
+  const size_t memo_depth = (options.memo_depth >= 0
+                             ? static_cast<size_t>(options.memo_depth)
+                             : 6 * (geometry.order - 1));
+  if (memo_depth >= geometry.n_cells) {
+    throw std::invalid_argument("memo depth must be less than "
+                                + std::to_string(geometry.n_cells));
+  }
+
+  const bool may_use_fast_path = (options.use_fast_path
+                                  && !use_memo
+                                  && geometry.n_cells == N_Hexes
+                                  && fill_order == geometry.spiral_order);
+
+  for (const int sum : sums) {
+    if (options.all_sums)
+      std::cout << "SUM: " << sum << "\n";
+
+    const SolvePlan & plan = shared_solve_plan(geometry, fill_order, sum, values);
+    run_reported_search(geometry.n_cells, [&](auto & sink, auto stats) {
+      using Sink = std::remove_reference_t<decltype(sink)>;
+      if (may_use_fast_path
+          && run_precompiled(static_cast<Precompiled_Value_Sets *>(nullptr),
+                             sorted_values, sum, sink, stats))
+        return;
+      output_raster_index = fill_order;
+      if (!use_memo) {
+        PlannedBoardStateT<Sink, decltype(stats)>{plan, sink, stats}.solve();
+        return;
+      }
+
+      PlannedTailTable table{plan, memo_depth, options.memo_n_entries};
+      try {
+        PlannedBoardStateT<Sink, decltype(stats)>{plan, sink, stats, &table}.solve();
+      } catch (const SearchStopped &) {
+        table.print();
+        throw;
+      }
+      table.print();
+    });
+  }
+}
+
+void optimise_fill_order()
+{
+  const HexGeometry & geometry = shared_geometry(options.order);
+  const FillOrderOptimiser optimiser{geometry};
+  const bool can_measure = geometry.has_integer_magic_sum();
+
+  // Returns the measured node count, or zero if the order has no
+  // integer magic sum and so cannot be measured.
+  auto report = [&](const std::string & label, const std::vector<size_t> & fill_order) {
+    const size_t n_nodes = can_measure ? measured_n_nodes(geometry, fill_order) : 0;
+    std::cout << label << ": predicted " << optimiser.predicted_n_nodes(fill_order);
+    if (can_measure)
+      std::cout << ", measured " << n_nodes;
+    std::cout << " nodes: " << fill_order_arg(fill_order) << "\n";
+    return n_nodes;
+  };
 
-  ArrayBoardState{dump<ArrUInt8>}.solve<RS>();
+  report("spiral", geometry.spiral_order);
+
+  auto candidates = optimiser.beam_search(options.beam_width);
+  if (candidates.size() > options.n_orders_measured)
+    candidates.resize(options.n_orders_measured);
+
+  std::vector<size_t> best_order = candidates.front().fill_order;
+  size_t best_n_nodes = SIZE_MAX;
+  for (const auto & candidate : candidates) {
+    const size_t n_nodes = report("candidate", candidate.fill_order);
+    if (can_measure && n_nodes < best_n_nodes) {
+      best_n_nodes = n_nodes;
+      best_order = candidate.fill_order;
+    }
+  }
+
+  std::cout << "BEST: --order " << options.order
+            << " --fill-order " << fill_order_arg(best_order) << "\n";
 }
 
+/*
+  Groups of options which only some strategies act on.
+*/
+enum OptionGroup : unsigned
+{
+  Order_Option = 1u << 0,        // "--order"
+  Generic_Options = 1u << 1,     // fill order, values, sum and tail table
+  Rank_Options = 1u << 2,        // "--start-rank", "--n-ranks", "--chunk-ranks"
+  Split_Depth_Option = 1u << 3,  // "--split-depth"
+  Allocator_Option = 1u << 4,    // "--allocator"
+  Symmetry_Option = 1u << 5,     // "--all-symmetries"
+};
+
+/*
+  A strategy, with what the drivers need to know about it: the order
+  its boards hold the cells in ("deduce-generic" sets its own), whether
+  it is too slow for "regress" to check and time, whether it supports
+  "--checkpoint", and which "OptionGroup"s it acts on.
+*/
 struct StrategyOption
 {
   std::string arg;
   std::string summary;
   std::function<void(void)> solve;
+  CellOrdering ordering = CellOrdering::Spiral;
+  bool slow = false;
+  bool checkpoints = false;
+  unsigned option_groups = 0;
+
+  // Throws "invalid_argument" if given options this strategy would
+  // silently ignore.
+  void check_options() const
+  {
+    const CommandLineOptions defaults;
+    const struct { OptionGroup group; bool given; const char * message; } groups[] = {
+      {Order_Option, options.order != defaults.order,
+       "\"--order\" is not supported"},
+      {Generic_Options,
+       (!options.fill_order.empty() || !options.values.empty()
+        || options.required_sum >= 0 || options.all_sums
+        || !options.use_fast_path || options.memo_n_entries != 0
+        || options.memo_depth >= 0),
+       "\"--fill-order\", \"--values\", \"--sum\", \"--all-sums\","
+       " \"--no-fast-path\", \"--memo-entries\" and \"--memo-depth\""
+       " are not supported"},
+      {Rank_Options,
+       (options.start_rank != defaults.start_rank
+        || options.n_ranks != defaults.n_ranks
+        || options.chunk_n_ranks != defaults.chunk_n_ranks),
+       "\"--start-rank\", \"--n-ranks\" and \"--chunk-ranks\" are not supported"},
+      {Split_Depth_Option, options.split_depth != defaults.split_depth,
+       "\"--split-depth\" is not supported"},
+      {Allocator_Option, options.pool_allocator,
+       "\"--allocator\" is not supported"},
+      {Symmetry_Option, options.expand_symmetries,
+       "\"--all-symmetries\" is not supported"},
+    };
+    for (const auto & group : groups)
+      if (group.given && (option_groups & group.group) == 0)
+        throw std::invalid_argument(group.message);
+  }
+
+  std::vector<size_t> raster_index() const
+  {
+    if (ordering == CellOrdering::Raster)
+      return {};
+    return {std::begin(spiral_to_raster), std::end(spiral_to_raster)};
+  }
 };
 
 static const std::vector<StrategyOption>
@@ -547,7 +3824,9 @@ strategies{
     once the board is completely filled whether it is a solution,
     using a vector of vectors of indexes to encode the lines.
     )",
-    solve_manual_perm<CheckVecOfVecs>
+    solve_manual_perm<CheckVecOfVecs>,
+    CellOrdering::Raster, /* slow */ true, /* checkpoints */ true,
+    Allocator_Option
   },
   {
     "manual-perm-hardcoded-check",
@@ -555,7 +3834,9 @@ strategies{
     As "manual-perm-vec-vecs-check", except check whether a board is a
     solution using a hard-coded list of"if" statements, one per line.
     )",
-    solve_manual_perm<CheckHardcoded>
+    solve_manual_perm<CheckHardcoded>,
+    CellOrdering::Raster, /* slow */ true, /* checkpoints */ true,
+    Allocator_Option
   },
   {
     "stdlib-perm-vec-vecs-check",
@@ -564,74 +3845,1474 @@ strategies{
     permutations using the standard library next_permutation()
     function.
     )",
-    solve_std_perm<CheckVecOfVecs>},
+    solve_std_perm<CheckVecOfVecs>,
+    CellOrdering::Raster, /* slow */ true, /* checkpoints */ true
+  },
+  {
+    "stdlib-perm-hardcoded-check",
+    R"(
+    As "manual-perm-hardcoded-check", except iterate over the
+    permutations using the standard library next_permutation()
+    function.
+    )",
+    solve_std_perm<CheckHardcoded>,
+    CellOrdering::Raster, /* slow */ true, /* checkpoints */ true
+  },
+  {
+    "stdlib-perm-batched-check",
+    R"(
+    As "stdlib-perm-hardcoded-check", except gather the permutations
+    into batches of 64 and check every line of a whole batch at once
+    with SIMD instructions.  Every board is batched, so unlike the
+    scalar checks this gains nothing from rejecting a board on its
+    first line alone.
+    )",
+    solve_std_perm_batched,
+    CellOrdering::Raster, /* slow */ true
+  },
+  {
+    "stdlib-perm-parallel",
+    R"(
+    As "stdlib-perm-hardcoded-check", except check the permutations
+    whose lexicographic ranks are given by "--start-rank" and
+    "--n-ranks", split into chunks of "--chunk-ranks" permutations
+    which are checked on all available cores.  Each chunk starts by
+    building its first permutation directly from its rank.
+    )",
+    solve_std_perm_parallel,
+    CellOrdering::Raster, /* slow */ true, /* checkpoints */ false,
+    Rank_Options
+  },
+  {
+    "line-by-line-check",
+    R"(
+    As soon as any line is filled, check whether that line has the
+    correct sum, and abandon the exploration if not.  Fill the cells
+    in raster order.
+    )",
+    solve_test_line_by_line<FillOrder::Raster>,
+    CellOrdering::Raster, /* slow */ true, /* checkpoints */ true,
+    Allocator_Option
+  },
+  {
+    "line-by-line-check-spiral",
+    R"(
+    As "line-by-line-check", except fill the cells in an inwards
+    spiral order.
+    )",
+    solve_test_line_by_line<FillOrder::Spiral>,
+    CellOrdering::Spiral, /* slow */ false, /* checkpoints */ true,
+    Allocator_Option
+  },
+  {
+    "deduce",
+    R"(
+    When filling in a cell which will complete a line, work out what
+    value has to be used to give the correct sum, and search for it
+    in the collection of available numbers.  Abandon the exploration
+    if it is not available.  Fill the cells in an inwards spiral order.
+    Store the board and the set of available numbers packed into one
+    128-bit value, so exploring a cell copies no more than that.
+    )",
+    solve_deduce_last_cell_of_line
+  },
+  {
+    "deduce-array",
+    R"(
+    As "deduce", except store the partially-filled board and the set
+    of available numbers in one 19-element array.
+    )",
+    solve_deduce_last_cell_of_line_array<RecursionStrategy::CreateNew>
+  },
+  {
+    "deduce-array-swap",
+    R"(
+    As "deduce-array", except instead of cloning the solver to explore
+    a possibility or deduction, swap elements, explore, then swap back.
+    )",
+    solve_deduce_last_cell_of_line_array<RecursionStrategy::SwapAndSwapBack>
+  },
+  {
+    "deduce-array-rotate",
+    R"(
+    As "deduce-array-swap", except when choosing a cell's value, swap
+    each candidate in with only one swap, and rotate the available
+    numbers back into place once all the candidates have been tried.
+    Solutions are found in a different order.
+    )",
+    solve_deduce_last_cell_of_line_array<RecursionStrategy::SwapThenRotateBack>
+  },
+  {
+    "deduce-array-swap-parallel",
+    R"(
+    As "deduce-array-swap", except split the search after the first
+    three choices into independent sub-searches, and run those on all
+    available cores using a work-stealing thread pool.
+    )",
+    solve_deduce_last_cell_of_line_array_parallel
+  },
+  {
+    "deduce-array-swap-bitmask",
+    R"(
+    As "deduce-array-swap", except also keep a bitmap of which numbers
+    are available, and where each one is in the array, so finding a
+    needed number takes no searching.
+    )",
+    solve_deduce_last_cell_of_line_array<RecursionStrategy::SwapAndSwapBack,
+                                         BitmaskLookup>
+  },
+  {
+    "deduce-array-swap-range-prune",
+    R"(
+    As "deduce-array-swap-bitmask", except after filling each cell,
+    abandon the exploration if any line through it which is not yet
+    complete can no longer reach the correct sum: if its partial sum
+    plus the smallest available numbers for its empty cells is too big,
+    or plus the largest is too small.
+    )",
+    solve_deduce_last_cell_of_line_array<RecursionStrategy::SwapAndSwapBack,
+                                         BitmaskLookup,
+                                         true>
+  },
+  {
+    "deduce-array-swap-simd",
+    R"(
+    As "deduce-array-swap", except look for a needed number by
+    comparing it against the whole array at once with SSE
+    instructions.
+    )",
+    solve_deduce_last_cell_of_line_array<RecursionStrategy::SwapAndSwapBack,
+                                         SimdScanLookup>
+  },
+  {
+    "deduce-array-swap-unrolled",
+    R"(
+    As "deduce-array-swap", except generate separate straight-line
+    code for the search for a needed number, and for the loop over
+    candidates, at each depth, so the number of available numbers is
+    fixed in each.  Try this in a profile-guided build, as described
+    at the top of the source.
+    )",
+    solve_deduce_last_cell_of_line_array<RecursionStrategy::SwapAndSwapBack,
+                                         UnrolledScanLookup>
+  },
+  {
+    "deduce-array-swap-line-sums",
+    R"(
+    As "deduce-array-swap", except also keep a running sum for every
+    line, updated with a single SSE addition whenever a cell is filled
+    or emptied, so deducing a value needs no adding up.
+    )",
+    solve_deduce_last_cell_of_line_array<RecursionStrategy::SwapAndSwapBack,
+                                         LineSumsLookup>
+  },
+  {
+    "deduce-array-swap-canonical",
+    R"(
+    As "deduce-array-swap", except only search for solutions in a
+    canonical form, to skip rotations and reflections: the top-left
+    corner holds the smallest corner value, and the top-right corner
+    is smaller than the left corner.  With "--all-symmetries", print
+    all twelve rotations and reflections of each solution found.
+    )",
+    solve_deduce_last_cell_of_line_array_canonical<>,
+    CellOrdering::Spiral, /* slow */ false, /* checkpoints */ false,
+    Symmetry_Option
+  },
+  {
+    "deduce-array-swap-iterative",
+    R"(
+    As "deduce-array-swap", except search with a loop over an explicit
+    stack of per-depth cursors rather than by recursion.
+    )",
+    solve_deduce_last_cell_of_line_array_iterative
+  },
+  {
+    "deduce-array-swap-lanes",
+    R"(
+    As "deduce-array-swap-iterative", except organised as a GPU would
+    run it, on the available cores: fill the first "--split-depth"
+    cells every possible way, then search below each of those partial
+    boards in a separate lane, in blocks of 256 lanes, gathering all
+    lanes' solutions into one buffer.
+    )",
+    solve_deduce_last_cell_of_line_array_lanes,
+    CellOrdering::Spiral, /* slow */ false, /* checkpoints */ false,
+    Split_Depth_Option
+  },
+  {
+    "deduce-generic",
+    R"(
+    As "deduce-array-swap", except work from a solve plan generated
+    for a hexagon of any order (set with "--order", default 3) rather
+    than from hard-coded tables.  Every line completed by a cell is
+    checked as soon as that cell is filled.  Cells are filled in
+    spiral order unless "--fill-order" is given.
+    )",
+    solve_deduce_generic,
+    CellOrdering::Spiral, /* slow */ false, /* checkpoints */ false,
+    Order_Option | Generic_Options
+  },
+  {
+    "optimise-fill-order",
+    R"(
+    Not a solver: beam-search for a fill order which minimises the
+    predicted number of nodes visited by "deduce-generic", measure the
+    most promising ones, and print the best as options for it.
+    )",
+    optimise_fill_order,
+    CellOrdering::Spiral, /* slow */ true, /* checkpoints */ false,
+    Order_Option
+  },
+};
+
+struct OptionHelp
+{
+  std::string arg;
+  std::string summary;
+};
+
+static const std::vector<OptionHelp>
+option_help{
+  {
+    "--order N",
+    R"(
+    Order (cells along each edge) of the hexagon, for strategies
+    which support it.  Default 3.
+    )"
+  },
+  {
+    "--fill-order C0,C1,...",
+    R"(
+    Raster indices of the cells in the order "deduce-generic" should
+    fill them.  Default is the inwards spiral.
+    )"
+  },
+  {
+    "--count",
+    R"(
+    Count the solutions rather than printing them.
+    )"
+  },
+  {
+    "--first N",
+    R"(
+    Stop the search as soon as N solutions have been found.  For
+    "deduce-array-swap-parallel" these are not necessarily the first
+    N that the single-threaded search would find.
+    )"
+  },
+  {
+    "--exists",
+    R"(
+    Only report whether there is any solution, stopping the search as
+    soon as one is found.
+    )"
+  },
+  {
+    "--start-rank R, --n-ranks N, --chunk-ranks N",
+    R"(
+    Range of permutation ranks (from 0, in next_permutation() order)
+    for "stdlib-perm-parallel" to check, and how many ranks each of
+    its tasks checks.  Defaults 0, 2500000000 and 16777216.
+    )"
+  },
+  {
+    "--split-depth D",
+    R"(
+    Number of cells "deduce-array-swap-lanes" fills before handing
+    each partial board to a lane of its own, from 1 to one less than
+    the number of cells.  Default 4.
+    )"
+  },
+  {
+    "--memo-entries N",
+    R"(
+    Make "deduce-generic" remember, in a table of N slots (rounded up
+    to a power of two), the solutions below each position it reaches
+    once it has filled as many cells as are in the outer ring, keyed
+    on the values left and the partial sums of the lines into the
+    remaining cells.  How often the table helped is printed after the
+    solutions.  Default 0, meaning no table.
+    )"
+  },
+  {
+    "--memo-depth D",
+    R"(
+    Number of cells "deduce-generic" fills before consulting its
+    "--memo-entries" table, less than the number of cells.  Default
+    is the number of cells in the outer ring.
+    )"
+  },
+  {
+    "--n-shards N",
+    R"(
+    Number of shard files "shard init" splits the search into.
+    Default 64.
+    )"
+  },
+  {
+    "--worker-id ID",
+    R"(
+    Name under which "shard work" claims shards.  A worker restarted
+    with the same name first finishes the shards it had claimed.
+    Default is the host name and process ID.
+    )"
+  },
+  {
+    "--reclaim-after S",
+    R"(
+    Let "shard work" take over shards claimed by other workers more
+    than S seconds ago, assuming those workers have died.  Default 0,
+    meaning never.
+    )"
+  },
+  {
+    "--checkpoint FILE",
+    R"(
+    For the "manual-perm-*", "stdlib-perm-*-check" and
+    "line-by-line-check*" strategies, save the search position to FILE
+    periodically, on bailing out, on stopping for "--first" or
+    "--exists", and on finishing.
+    )"
+  },
+  {
+    "--checkpoint-every S",
+    R"(
+    Seconds between checkpoints.  Default 60.
+    )"
+  },
+  {
+    "--resume",
+    R"(
+    Carry on from the position saved in the "--checkpoint" file, if it
+    exists, rather than starting from the beginning.
+    )"
+  },
+  {
+    "--values V,A..B,...",
+    R"(
+    Pool of values for "deduce-generic" to place, as a list of values
+    and ranges.  Repeats are allowed, and there may be more values than
+    cells.  Default 1 up to the number of cells.
+    )"
+  },
+  {
+    "--sum S",
+    R"(
+    Magic sum for "deduce-generic".  Default is the pool's total
+    divided by the number of rows, which needs the pool to be exactly
+    the size of the board.
+    )"
+  },
+  {
+    "--all-sums",
+    R"(
+    Make "deduce-generic" search every magic sum the pool could give,
+    reporting each one's solutions after a "SUM:" line.
+    )"
+  },
+  {
+    "--no-fast-path",
+    R"(
+    Stop "deduce-generic" handing over to a compiled-in array solver
+    when its configuration matches one.
+    )"
+  },
+  {
+    "--allocator system|pool",
+    R"(
+    For the "manual-perm-*" and "line-by-line-check*" strategies,
+    allocate the board vectors with the system allocator (the default)
+    or from a pool of fixed-size blocks reused throughout the search.
+    )"
+  },
+  {
+    "--binary-output FILE",
+    R"(
+    Write the solutions to FILE in a compact binary format, five bits
+    per cell for the default values, rather than printing them.
+    "solve-hex decode FILE" prints them back as text.
+    )"
+  },
+  {
+    "--async-output N",
+    R"(
+    Pass solutions to a separate writer thread through a queue of N
+    solutions, so that writing them out does not hold up the search,
+    and report afterwards how often the search had to wait for room.
+    )"
+  },
+  {
+    "--stats",
+    R"(
+    For the search-tree strategies, count nodes visited, deductions
+    attempted and failed, and candidates pruned at each depth, and
+    print them after the solutions.
+    )"
+  },
+  {
+    "--perf",
+    R"(
+    Count CPU cycles, instructions, branch misses, L1 data-cache read
+    misses and CPU time with the Linux perf_event_open() interface,
+    and print them after the solutions (and the "--stats" counts).
+    The counts cover only the reported search, not the repeated
+    searches some strategies make before it.
+    )"
+  },
+  {
+    "--all-symmetries",
+    R"(
+    For symmetry-reduced strategies, print every rotation and
+    reflection of each canonical solution found.
+    )"
+  },
+  {
+    "--format json|csv",
+    R"(
+    Output format for "bench".  Default json.
+    )"
+  },
   {
-    "stdlib-perm-hardcoded-check",
+    "--warmup N",
     R"(
-    As "manual-perm-hardcoded-check", except iterate over the
-    permutations using the standard library next_permutation()
-    function.
-    )",
-    solve_std_perm<CheckHardcoded>
+    Untimed runs "bench" does before timing.  Default 1.
+    )"
   },
   {
-    "line-by-line-check",
+    "--min-runs N, --max-runs N, --max-seconds S",
     R"(
-    As soon as any line is filled, check whether that line has the
-    correct sum, and abandon the exploration if not.  Fill the cells
-    in raster order.
-    )",
-    solve_test_line_by_line<FillOrder::Raster>
+    Bounds on how many timed runs "bench" does, and for how long.
+    Defaults 5, 200 and 30.
+    )"
   },
   {
-    "line-by-line-check-spiral",
+    "--target-ci F",
     R"(
-    As "line-by-line-check", except fill the cells in an inwards
-    spiral order.
-    )",
-    solve_test_line_by_line<FillOrder::Spiral>
+    "bench" stops once the 95% confidence interval for the mean run
+    time is within this fraction of the mean.  Default 0.02.
+    )"
   },
   {
-    "deduce",
+    "--baseline FILE",
     R"(
-    When filling in a cell which will complete a line, work out what
-    value has to be used to give the correct sum, and search for it
-    in the collection of available numbers.  Abandon the exploration
-    if it is not available.  Fill the cells in an inwards spiral order.
-    )",
-    solve_deduce_last_cell_of_line
+    JSON printed by an earlier "regress" run, to compare this run's
+    times against.
+    )"
   },
   {
-    "deduce-array",
+    "--max-slowdown F",
     R"(
-    As "deduce", except store the partially-filled board and the set
-    of available numbers in one 19-element array.
-    )",
-    solve_deduce_last_cell_of_line_array<RecursionStrategy::CreateNew>
+    Fraction by which "regress" lets a strategy's median time exceed
+    its baseline before failing.  Default 0.05.
+    )"
   },
   {
-    "deduce-array-swap",
+    "--beam-width N",
     R"(
-    As "deduce-array", except instead of cloning the solver to explore
-    a possibility or deduction, swap elements, explore, then swap back.
-    )",
-    solve_deduce_last_cell_of_line_array<RecursionStrategy::SwapAndSwapBack>
+    Number of partial orders "optimise-fill-order" keeps at each
+    step.  Default 200.
+    )"
+  },
+  {
+    "--n-measured N",
+    R"(
+    Number of complete orders "optimise-fill-order" measures by
+    running the solver.  Default 8.
+    )"
   },
 };
 
-int main(int argc, char ** argv)
+// Parse a list like "1..10,12,15" of values and ranges of values.
+VecUInt8 values_arg(const std::string & arg)
+{
+  VecUInt8 values;
+  std::istringstream items{arg};
+  std::string item;
+  while (std::getline(items, item, ',')) {
+    const size_t range_pos = item.find("..");
+    const int first = std::stoi(item.substr(0, range_pos));
+    const int last = (range_pos == std::string::npos
+                      ? first
+                      : std::stoi(item.substr(range_pos + 2)));
+    if (first < 0 || last > 255 || last < first)
+      throw std::invalid_argument("bad values");
+    for (int v = first; v <= last; ++v)
+      values.push_back(static_cast<uint8_t>(v));
+  }
+  return values;
+}
+
+bool parse_options(int argc, char ** argv, int first_option_idx)
+{
+  try {
+    for (int i = first_option_idx; i < argc; ++i) {
+      const std::string arg{argv[i]};
+      const bool have_value = (i + 1 < argc);
+      if (arg == "--order" && have_value) {
+        options.order = std::stoul(argv[++i]);
+        if (options.order < 1 || options.order > 9) {
+          std::cerr << "Order must be between 1 and 9\n";
+          return false;
+        }
+      } else if (arg == "--fill-order" && have_value) {
+        options.fill_order.clear();
+        std::istringstream cells{argv[++i]};
+        std::string cell;
+        while (std::getline(cells, cell, ','))
+          options.fill_order.push_back(std::stoul(cell));
+      } else if (arg == "--format" && have_value) {
+        options.bench_format = argv[++i];
+        if (options.bench_format != "json" && options.bench_format != "csv") {
+          std::cerr << "Format must be \"json\" or \"csv\"\n";
+          return false;
+        }
+      } else if (arg == "--warmup" && have_value) {
+        options.bench_n_warmup_runs = std::stoul(argv[++i]);
+      } else if (arg == "--min-runs" && have_value) {
+        options.bench_min_runs = std::max<size_t>(2, std::stoul(argv[++i]));
+      } else if (arg == "--max-runs" && have_value) {
+        options.bench_max_runs = std::max<size_t>(2, std::stoul(argv[++i]));
+      } else if (arg == "--max-seconds" && have_value) {
+        options.bench_max_seconds = std::stod(argv[++i]);
+      } else if (arg == "--target-ci" && have_value) {
+        options.bench_target_ci = std::stod(argv[++i]);
+      } else if (arg == "--count") {
+        options.count_only = true;
+      } else if (arg == "--exists") {
+        options.exists_only = true;
+      } else if (arg == "--first" && have_value) {
+        options.n_solutions_wanted = std::max<size_t>(1, std::stoul(argv[++i]));
+      } else if (arg == "--start-rank" && have_value) {
+        options.start_rank = std::stoull(argv[++i]);
+      } else if (arg == "--n-ranks" && have_value) {
+        options.n_ranks = std::stoull(argv[++i]);
+      } else if (arg == "--chunk-ranks" && have_value) {
+        options.chunk_n_ranks = std::max<uint64_t>(1, std::stoull(argv[++i]));
+      } else if (arg == "--n-shards" && have_value) {
+        options.n_shards = std::max<size_t>(1, std::stoul(argv[++i]));
+      } else if (arg == "--worker-id" && have_value) {
+        options.worker_id = argv[++i];
+      } else if (arg == "--reclaim-after" && have_value) {
+        options.reclaim_after_seconds = std::stod(argv[++i]);
+      } else if (arg == "--checkpoint" && have_value) {
+        checkpoint_path = argv[++i];
+      } else if (arg == "--checkpoint-every" && have_value) {
+        checkpoint_period_seconds = std::stod(argv[++i]);
+      } else if (arg == "--resume") {
+        options.resume = true;
+      } else if (arg == "--values" && have_value) {
+        options.values = values_arg(argv[++i]);
+      } else if (arg == "--sum" && have_value) {
+        options.required_sum = std::stoi(argv[++i]);
+        if (options.required_sum < 0)
+          throw std::invalid_argument("bad sum");
+      } else if (arg == "--all-sums") {
+        options.all_sums = true;
+      } else if (arg == "--no-fast-path") {
+        options.use_fast_path = false;
+      } else if (arg == "--allocator" && have_value) {
+        const std::string allocator = argv[++i];
+        if (allocator != "system" && allocator != "pool")
+          throw std::invalid_argument("unknown allocator \"" + allocator + "\"");
+        options.pool_allocator = (allocator == "pool");
+      } else if (arg == "--binary-output" && have_value) {
+        options.binary_output_path = argv[++i];
+      } else if (arg == "--async-output" && have_value) {
+        options.async_queue_size = std::stoul(argv[++i]);
+        if (options.async_queue_size == 0)
+          throw std::invalid_argument("queue size must be positive");
+      } else if (arg == "--stats") {
+        options.collect_stats = true;
+      } else if (arg == "--split-depth" && have_value) {
+        options.split_depth = std::stoul(argv[++i]);
+        if (options.split_depth < 1 || options.split_depth >= N_Hexes)
+          throw std::invalid_argument("bad split depth");
+      } else if (arg == "--memo-entries" && have_value) {
+        options.memo_n_entries = std::stoul(argv[++i]);
+      } else if (arg == "--memo-depth" && have_value) {
+        options.memo_depth = std::stoi(argv[++i]);
+        if (options.memo_depth < 0)
+          throw std::invalid_argument("bad memo depth");
+      } else if (arg == "--perf") {
+        options.perf_counters = true;
+      } else if (arg == "--all-symmetries") {
+        options.expand_symmetries = true;
+      } else if (arg == "--baseline" && have_value) {
+        options.regress_baseline_path = argv[++i];
+      } else if (arg == "--max-slowdown" && have_value) {
+        options.regress_max_slowdown = std::stod(argv[++i]);
+      } else if (arg == "--beam-width" && have_value) {
+        options.beam_width = std::max<size_t>(1, std::stoul(argv[++i]));
+      } else if (arg == "--n-measured" && have_value) {
+        options.n_orders_measured = std::max<size_t>(1, std::stoul(argv[++i]));
+      } else {
+        std::cerr << "Bad option \"" << arg << "\"\n";
+        return false;
+      }
+    }
+  } catch (const std::exception &) {
+    std::cerr << "Bad option value\n";
+    return false;
+  }
+
+  return true;
+}
+
+/*
+  Benchmarking: time single runs of a strategy, with the quick
+  strategies' extra repeats turned off and the solutions discarded,
+  until the 95% confidence interval for the mean is narrow enough.
+  Strategies which bail out after "n_attempts_bail" are timed up to
+  that point.
+*/
+struct NullBuffer : std::streambuf
+{
+  int overflow(int c) override { return c; }
+};
+
+struct BenchmarkResult
+{
+  std::string strategy;
+  std::vector<double> run_seconds;
+
+  double quantile(double q) const
+  {
+    std::vector<double> sorted{run_seconds};
+    std::sort(sorted.begin(), sorted.end());
+    const double pos = q * (sorted.size() - 1);
+    const size_t lo = static_cast<size_t>(pos);
+    const size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
+  }
+
+  double mean() const
+  {
+    return std::accumulate(run_seconds.begin(), run_seconds.end(), 0.0)
+      / run_seconds.size();
+  }
+
+  // Half-width of the 95% confidence interval for the mean, using
+  // Student's t distribution for small samples.
+  double ci95_half_width() const
+  {
+    static const double t_975[] = {
+      12.71, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+      2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+      2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    const size_t n = run_seconds.size();
+    if (n < 2)
+      return INFINITY;
+
+    const double m = mean();
+    double sum_sq = 0.0;
+    for (const auto t : run_seconds)
+      sum_sq += (t - m) * (t - m);
+    const double sd = std::sqrt(sum_sq / (n - 1));
+    const size_t df = n - 1;
+    const double t = (df <= 30) ? t_975[df - 1] : 1.96;
+    return t * sd / std::sqrt(static_cast<double>(n));
+  }
+};
+
+double time_one_run(const StrategyOption & strat)
+{
+  n_attempts = 0;
+  const auto start = std::chrono::steady_clock::now();
+  try {
+    strat.solve();
+  } catch (const SearchBailed &) {
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+BenchmarkResult run_benchmark(const StrategyOption & strat)
+{
+  BenchmarkResult result{strat.arg, {}};
+  output_raster_index = strat.raster_index();
+
+  NullBuffer null_buffer;
+  auto * const cout_buffer = std::cout.rdbuf(&null_buffer);
+  const auto saved_n_quiet_repeats = n_quiet_repeats;
+  n_quiet_repeats = 0;
+
+  try {
+    for (size_t i = 0; i != options.bench_n_warmup_runs; ++i)
+      time_one_run(strat);
+
+    double total_seconds = 0.0;
+    while (result.run_seconds.size() < options.bench_max_runs) {
+      result.run_seconds.push_back(time_one_run(strat));
+      total_seconds += result.run_seconds.back();
+
+      if (result.run_seconds.size() < options.bench_min_runs)
+        continue;
+      if (result.ci95_half_width() <= options.bench_target_ci * result.mean())
+        break;
+      if (total_seconds >= options.bench_max_seconds)
+        break;
+    }
+  } catch (...) {
+    n_quiet_repeats = saved_n_quiet_repeats;
+    std::cout.rdbuf(cout_buffer);
+    throw;
+  }
+
+  n_quiet_repeats = saved_n_quiet_repeats;
+  std::cout.rdbuf(cout_buffer);
+  return result;
+}
+
+/*
+  The CSV "summary" and "time" columns are the strategy name and its
+  median time in seconds, so the file reads straight into the
+  "summary"/"time" records of runtimes.ipynb.
+*/
+void print_benchmark_results(const std::vector<BenchmarkResult> & results)
+{
+  if (options.bench_format == "csv") {
+    std::cout << "summary,n_runs,time,min,p95,mean,ci95\n";
+    for (const auto & r : results) {
+      std::cout << r.strategy << "," << r.run_seconds.size()
+                << "," << r.quantile(0.5) << "," << r.quantile(0.0)
+                << "," << r.quantile(0.95) << "," << r.mean()
+                << "," << r.ci95_half_width() << "\n";
+    }
+    return;
+  }
+
+  std::cout << "[\n";
+  for (size_t i = 0; i != results.size(); ++i) {
+    const auto & r = results[i];
+    std::cout << "  {\"strategy\": \"" << r.strategy << "\""
+              << ", \"n_runs\": " << r.run_seconds.size()
+              << ", \"time\": " << r.quantile(0.5)
+              << ", \"min\": " << r.quantile(0.0)
+              << ", \"p95\": " << r.quantile(0.95)
+              << ", \"mean\": " << r.mean()
+              << ", \"ci95\": " << r.ci95_half_width() << "}"
+              << (i + 1 == results.size() ? "\n" : ",\n");
+  }
+  std::cout << "]\n";
+}
+
+/*
+  "solve-hex regress" checks and times every strategy which finishes
+  quickly.  First each one is run once with "--stats" and
+  "--all-symmetries", and its solutions, in raster order, must be
+  exactly those of "deduce-array-swap", which must be twelve valid
+  boards.  Then each is timed as "bench" does, and the results are
+  printed as JSON, with the node count from the checking run and the
+  nodes visited per second.  With "--baseline FILE", a previous
+  "regress" output, each median time is compared against the one
+  there.  "deduce-generic" is also run on each of "generic_cases",
+  configurations whose number of solutions is known.  The exit status is
+  non-zero if any strategy gave the wrong solutions or was slower than
+  its baseline by more than "--max-slowdown".
+*/
+struct RegressionResult
+{
+  const StrategyOption * strat;
+  BenchmarkResult timing;
+  std::vector<VecUInt8> solutions;
+  size_t n_nodes;
+  bool correct;
+};
+
+// Runs "strat" once, returning its solutions, sorted, and setting
+// "n_nodes" to the total from its "STATS:" lines (zero for strategies
+// which do not count nodes).  Returns false if the run failed.
+bool checked_solutions(const StrategyOption & strat,
+                       std::vector<VecUInt8> & solutions,
+                       size_t & n_nodes)
+{
+  const CommandLineOptions saved_options{options};
+  options.collect_stats = true;
+  options.expand_symmetries = true;
+  output_raster_index = strat.raster_index();
+  const auto saved_n_quiet_repeats = n_quiet_repeats;
+  n_quiet_repeats = 0;
+  n_attempts = 0;
+
+  std::ostringstream out;
+  auto * const cout_buffer = std::cout.rdbuf(out.rdbuf());
+  bool ok = true;
+  try {
+    strat.solve();
+  } catch (const SearchBailed &) {
+    ok = false;
+  } catch (const std::exception &) {
+    ok = false;
+  }
+  std::cout.rdbuf(cout_buffer);
+  n_quiet_repeats = saved_n_quiet_repeats;
+  options = saved_options;
+
+  std::istringstream lines{out.str()};
+  solutions.clear();
+  n_nodes = 0;
+  for (std::string line; std::getline(lines, line); ) {
+    std::istringstream words{line};
+    std::string tag;
+    words >> tag;
+    if (tag == "HEX:") {
+      VecUInt8 board;
+      for (int n; words >> n; )
+        board.push_back(static_cast<uint8_t>(n));
+      solutions.push_back(board);
+    }
+    else if (tag == "STATS:") {
+      size_t depth = 0, n_depth_nodes = 0;
+      if (words >> depth >> n_depth_nodes)
+        n_nodes += n_depth_nodes;
+    }
+  }
+  std::sort(solutions.begin(), solutions.end());
+  return ok;
+}
+
+const StrategyOption * find_strategy(const std::string & arg)
+{
+  for (const auto & strat : strategies)
+    if (strat.arg == arg)
+      return &strat;
+  return nullptr;
+}
+
+/*
+  Configurations of "deduce-generic" with a known number of solutions.
+  Each solution found must be magic, with the given sum if there is
+  one, and use values from the pool, and no two may be the same, so
+  finding the right number of them means finding exactly the right
+  ones.  The order-3 cases run the plan-driven engine rather than the
+  compiled array solver it would otherwise hand over to.
+*/
+struct GenericCase
+{
+  std::string description;
+  size_t order;
+  VecUInt8 values;
+  int required_sum;
+  std::vector<size_t> fill_order;
+  bool use_fast_path;
+  size_t memo_n_entries;
+  int memo_depth;
+  size_t n_solutions;
+};
+
+static const std::vector<GenericCase>
+generic_cases{
+  {"order 1", 1, {}, -1, {}, true, 0, -1, 1},
+  {"order 1, values 1..3, sum 2", 1, {1, 2, 3}, 2, {}, true, 0, -1, 1},
+  {"order 1, values 1..3, sum 4", 1, {1, 2, 3}, 4, {}, true, 0, -1, 0},
+  {"order 3, no fast path", 3, {}, -1, {}, false, 0, -1, 12},
+  {"order 3, values 1..22, sum 40", 3,
+   {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22},
+   40, {}, true, 0, -1, 72},
+  {"order 3, fill order 0,1,2,3,7,6,11,12,16,15,18,17,4,5,8,10,9,13,14", 3, {}, -1,
+   {0, 1, 2, 3, 7, 6, 11, 12, 16, 15, 18, 17, 4, 5, 8, 10, 9, 13, 14}, true, 0, -1, 12},
+  {"order 3, tail table of 4096 slots", 3, {}, -1, {}, true, 4096, -1, 12},
+  // Deep enough for lookups to hit positions with solutions below them.
+  {"order 3, values 1..22, sum 40, tail table at depth 17", 3,
+   {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22},
+   40, {}, true, 65536, 17, 72},
+};
+
+// Whether "board", in raster order, is a magic hexagon of the given
+// order using values from "pool" (1 up to the number of cells if
+// empty), with magic sum "required_sum" unless that is negative.
+bool is_magic_from_pool(const VecUInt8 & board, size_t order,
+                        VecUInt8 pool, int required_sum)
+{
+  const HexGeometry & geometry = shared_geometry(order);
+  if (board.size() != geometry.n_cells)
+    return false;
+
+  if (pool.empty()) {
+    pool.resize(geometry.n_cells);
+    std::iota(pool.begin(), pool.end(), 1);
+  }
+  VecUInt8 sorted_board{board};
+  std::sort(sorted_board.begin(), sorted_board.end());
+  std::sort(pool.begin(), pool.end());
+  if (!std::includes(pool.begin(), pool.end(), sorted_board.begin(), sorted_board.end()))
+    return false;
+
+  int sum = required_sum;
+  for (const auto & line : geometry.lines) {
+    int line_sum = 0;
+    for (const auto cell : line)
+      line_sum += board[cell];
+    if (sum < 0)
+      sum = line_sum;
+    if (line_sum != sum)
+      return false;
+  }
+  return true;
+}
+
+// Runs "deduce-generic" on each of "generic_cases", returning whether
+// all of them gave the expected solutions.
+bool generic_cases_correct()
+{
+  const StrategyOption & strat = *find_strategy("deduce-generic");
+  bool all_correct = true;
+  for (const auto & generic_case : generic_cases) {
+    const CommandLineOptions saved_options{options};
+    options.order = generic_case.order;
+    options.values = generic_case.values;
+    options.required_sum = generic_case.required_sum;
+    options.fill_order = generic_case.fill_order;
+    options.use_fast_path = generic_case.use_fast_path;
+    options.memo_n_entries = generic_case.memo_n_entries;
+    options.memo_depth = generic_case.memo_depth;
+    std::vector<VecUInt8> solutions;
+    size_t n_nodes = 0;
+    const bool ok = checked_solutions(strat, solutions, n_nodes);
+    options = saved_options;
+
+    const bool correct = (
+      ok
+      && solutions.size() == generic_case.n_solutions
+      && std::adjacent_find(solutions.begin(), solutions.end()) == solutions.end()
+      && std::all_of(solutions.begin(), solutions.end(), [&](const VecUInt8 & board) {
+           return is_magic_from_pool(board, generic_case.order,
+                                     generic_case.values, generic_case.required_sum);
+         }));
+    if (!correct) {
+      std::cerr << "WRONG: deduce-generic found " << solutions.size()
+                << " solutions for " << generic_case.description
+                << ", expecting " << generic_case.n_solutions << "\n";
+      all_correct = false;
+    }
+  }
+  return all_correct;
+}
+
+// Median times by strategy from the JSON which "regress" prints.
+std::map<std::string, double> read_baseline_times(const std::string & path)
+{
+  std::ifstream in{path};
+  if (!in)
+    throw std::runtime_error("could not read " + path);
+
+  std::map<std::string, double> times;
+  static const std::string strategy_tag = "\"strategy\": \"";
+  static const std::string time_tag = "\"time\": ";
+  for (std::string line; std::getline(in, line); ) {
+    const size_t strategy_pos = line.find(strategy_tag);
+    const size_t time_pos = line.find(time_tag);
+    if (strategy_pos == std::string::npos || time_pos == std::string::npos)
+      continue;
+    const size_t name_start = strategy_pos + strategy_tag.size();
+    const std::string name = line.substr(name_start, line.find('"', name_start) - name_start);
+    times[name] = std::stod(line.substr(time_pos + time_tag.size()));
+  }
+  return times;
+}
+
+int run_regression_suite()
+{
+  std::vector<RegressionResult> results;
+  for (const auto & strat : strategies) {
+    if (strat.slow)
+      continue;
+    RegressionResult result{&strat, {strat.arg, {}}, {}, 0, false};
+    result.correct = checked_solutions(strat, result.solutions, result.n_nodes);
+    results.push_back(result);
+  }
+
+  const auto & reference = std::find_if(
+    results.begin(), results.end(),
+    [](const RegressionResult & r) { return r.timing.strategy == "deduce-array-swap"; }
+  )->solutions;
+  const bool reference_ok = (reference.size() == 12
+                             && std::all_of(reference.begin(), reference.end(),
+                                            raster_solution_is_correct<VecUInt8>));
+
+  int status = 0;
+  for (auto & result : results) {
+    result.correct = result.correct && reference_ok && result.solutions == reference;
+    if (!result.correct) {
+      std::cerr << "WRONG: " << result.timing.strategy << " found "
+                << result.solutions.size() << " solutions which do not match"
+                << " those of deduce-array-swap\n";
+      status = 1;
+    }
+  }
+  if (!generic_cases_correct())
+    status = 1;
+
+  for (auto & result : results)
+    result.timing = run_benchmark(*result.strat);
+
+  std::cout << "[\n";
+  for (size_t i = 0; i != results.size(); ++i) {
+    const auto & r = results[i];
+    const double median = r.timing.quantile(0.5);
+    std::cout << "  {\"strategy\": \"" << r.timing.strategy << "\""
+              << ", \"correct\": " << (r.correct ? "true" : "false")
+              << ", \"n_solutions\": " << r.solutions.size()
+              << ", \"n_nodes\": " << r.n_nodes
+              << ", \"n_runs\": " << r.timing.run_seconds.size()
+              << ", \"time\": " << median
+              << ", \"min\": " << r.timing.quantile(0.0)
+              << ", \"p95\": " << r.timing.quantile(0.95)
+              << ", \"ci95\": " << r.timing.ci95_half_width()
+              << ", \"nodes_per_second\": " << r.n_nodes / median << "}"
+              << (i + 1 == results.size() ? "\n" : ",\n");
+  }
+  std::cout << "]\n";
+
+  if (!options.regress_baseline_path.empty()) {
+    const auto baseline = read_baseline_times(options.regress_baseline_path);
+    for (const auto & r : results) {
+      const auto found = baseline.find(r.timing.strategy);
+      if (found == baseline.end())
+        continue;
+      const double slowdown = r.timing.quantile(0.5) / found->second - 1.0;
+      if (slowdown > options.regress_max_slowdown) {
+        std::ostringstream percent;
+        percent << std::fixed << std::setprecision(1) << 100.0 * slowdown;
+        std::cerr << "REGRESSION: " << r.timing.strategy << " took "
+                  << r.timing.quantile(0.5) << "s against " << found->second
+                  << "s in the baseline (" << percent.str() << "% slower)\n";
+        status = 1;
+      }
+    }
+  }
+  return status;
+}
+
+/*
+  Distributed search, coordinated through files in a directory shared
+  between machines.  "shard init" writes the search prefixes, the
+  boards with the first "Parallel_Split_Depth" cells filled, into
+  shard files "shard-NNNNN.todo".  Each "shard work" process claims a
+  shard by renaming it to "shard-NNNNN.claimed-ID", which at most one
+  worker can do; finishes it with the iterative solver; writes
+  "shard-NNNNN.result" via a temporary file and rename; and deletes its
+  claim.  A restarted worker resumes its own claims first, and with
+  "--reclaim-after" takes over claims left behind by others.  Running a
+  shard twice is harmless, since results only ever replace identical
+  results.  "shard collect" reports the solutions from all results in
+  shard order, or lists the shards still outstanding.
+*/
+const std::string Shard_Manifest_Name = "manifest";
+
+std::string shard_name(size_t shard_idx)
+{
+  std::ostringstream name;
+  name << "shard-" << std::setw(5) << std::setfill('0') << shard_idx;
+  return name.str();
+}
+
+std::string default_worker_id()
+{
+  char host_name[256] = "host";
+  gethostname(host_name, sizeof(host_name) - 1);
+  return std::string{host_name} + "-" + std::to_string(getpid());
+}
+
+void write_file_atomically(const std::filesystem::path & path,
+                           const std::string & contents)
+{
+  std::filesystem::path tmp_path{path};
+  tmp_path += ".tmp-" + options.worker_id;
+  {
+    std::ofstream out{tmp_path};
+    out << contents;
+    if (!out)
+      throw std::runtime_error("could not write " + tmp_path.string());
+  }
+  std::filesystem::rename(tmp_path, path);
+}
+
+void write_board(std::ostream & out, const char * tag, const ArrUInt8 & board)
+{
+  out << tag << ":";
+  for (const uint8_t n : board)
+    out << " " << static_cast<int>(n);
+  out << "\n";
+}
+
+std::vector<ArrUInt8> read_boards(const std::filesystem::path & path,
+                                  const std::string & tag)
+{
+  std::ifstream in{path};
+  if (!in)
+    throw std::runtime_error("could not read " + path.string());
+
+  std::vector<ArrUInt8> boards;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields{line};
+    std::string line_tag;
+    fields >> line_tag;
+    if (line_tag != tag + ":")
+      continue;
+
+    ArrUInt8 board;
+    for (auto & n : board) {
+      int value = 0;
+      fields >> value;
+      n = static_cast<uint8_t>(value);
+    }
+    if (!fields)
+      throw std::runtime_error("malformed line in " + path.string());
+    boards.push_back(board);
+  }
+  return boards;
+}
+
+size_t read_n_shards(const std::filesystem::path & dir)
+{
+  std::ifstream in{dir / Shard_Manifest_Name};
+  std::string tag;
+  size_t n_shards = 0;
+  if (!(in >> tag >> n_shards) || tag != "SHARDS:")
+    throw std::runtime_error("no shard manifest in " + dir.string());
+  return n_shards;
+}
+
+void init_shards(const std::filesystem::path & dir)
+{
+  std::filesystem::create_directories(dir);
+
+  const auto prefixes = array_board_prefixes();
+  const size_t n_shards = std::min(options.n_shards, prefixes.size());
+  for (size_t shard_idx = 0; shard_idx != n_shards; ++shard_idx) {
+    std::ostringstream contents;
+    const size_t begin = prefixes.size() * shard_idx / n_shards;
+    const size_t end = prefixes.size() * (shard_idx + 1) / n_shards;
+    for (size_t i = begin; i != end; ++i)
+      write_board(contents, "PREFIX", prefixes[i]);
+    write_file_atomically(dir / (shard_name(shard_idx) + ".todo"), contents.str());
+  }
+
+  // Written last, so workers never see a partial set of shards.
+  std::ostringstream manifest;
+  manifest << "SHARDS: " << n_shards << "\n"
+           << "DEPTH: " << Parallel_Split_Depth << "\n"
+           << "PREFIXES: " << prefixes.size() << "\n";
+  write_file_atomically(dir / Shard_Manifest_Name, manifest.str());
+  std::cout << "SHARDS: " << n_shards << "\n";
+}
+
+/*
+  Claim a shard, returning the path of its claim file, or an empty path
+  if there is nothing left to claim.  Claims whose results are already
+  written are from workers which died before deleting them, so are
+  just tidied away.
+*/
+std::filesystem::path claim_shard(const std::filesystem::path & dir,
+                                  size_t n_shards,
+                                  size_t & claimed_idx)
+{
+  const std::string own_claim_suffix = ".claimed-" + options.worker_id;
+  const auto now = std::filesystem::file_time_type::clock::now();
+  const auto reclaim_after = std::chrono::duration_cast<
+    std::filesystem::file_time_type::duration>(
+      std::chrono::duration<double>(options.reclaim_after_seconds));
+
+  // Other workers' claims old enough to take over, by shard.
+  std::vector<std::vector<std::filesystem::path>> stale_claims(n_shards);
+  if (options.reclaim_after_seconds > 0.0) {
+    for (const auto & entry : std::filesystem::directory_iterator{dir}) {
+      const std::string entry_name = entry.path().filename().string();
+      const size_t claim_pos = entry_name.find(".claimed-");
+      if (entry_name.rfind("shard-", 0) != 0 || claim_pos == std::string::npos)
+        continue;
+      if (entry_name.compare(claim_pos, std::string::npos, own_claim_suffix) == 0)
+        continue;
+      const size_t shard_idx = std::stoul(entry_name.substr(6, claim_pos - 6));
+      if (shard_idx < n_shards
+          && now - std::filesystem::last_write_time(entry.path()) > reclaim_after)
+        stale_claims[shard_idx].push_back(entry.path());
+    }
+  }
+
+  for (int pass = 0; pass != 3; ++pass) {
+    for (size_t shard_idx = 0; shard_idx != n_shards; ++shard_idx) {
+      const std::string name = shard_name(shard_idx);
+      const auto own_claim = dir / (name + own_claim_suffix);
+      const bool have_result = std::filesystem::exists(dir / (name + ".result"));
+
+      std::vector<std::filesystem::path> candidates;
+      if (pass == 0)
+        candidates.push_back(own_claim);
+      else if (pass == 1)
+        candidates.push_back(dir / (name + ".todo"));
+      else
+        candidates = stale_claims[shard_idx];
+
+      for (const auto & candidate : candidates) {
+        std::error_code error;
+        if (candidate != own_claim)
+          std::filesystem::rename(candidate, own_claim, error);
+        if (error || !std::filesystem::exists(own_claim))
+          continue;
+
+        if (have_result) {
+          std::filesystem::remove(own_claim);
+          continue;
+        }
+
+        std::filesystem::last_write_time(own_claim, now);
+        claimed_idx = shard_idx;
+        return own_claim;
+      }
+    }
+  }
+
+  return {};
+}
+
+void run_shard_worker(const std::filesystem::path & dir)
+{
+  const size_t n_shards = read_n_shards(dir);
+
+  size_t shard_idx = 0;
+  while (true) {
+    const auto claim_path = claim_shard(dir, n_shards, shard_idx);
+    if (claim_path.empty())
+      break;
+
+    CollectSink<ArrUInt8> solutions;
+    IterativeArrayBoardStateT<CollectSink<ArrUInt8>> state{solutions};
+    for (const auto & prefix : read_boards(claim_path, "PREFIX")) {
+      state.set_numbers(prefix);
+      state.solve(Parallel_Split_Depth);
+    }
+
+    std::ostringstream result;
+    result << "COUNT: " << solutions.boards.size() << "\n";
+    for (const auto & board : solutions.boards)
+      write_board(result, "HEX", board);
+    write_file_atomically(dir / (shard_name(shard_idx) + ".result"), result.str());
+    std::filesystem::remove(claim_path);
+
+    std::cout << "SHARD: " << shard_idx
+              << " COUNT: " << solutions.boards.size() << "\n";
+  }
+}
+
+// Returns whether every shard has a result.
+bool collect_shards(const std::filesystem::path & dir)
+{
+  const size_t n_shards = read_n_shards(dir);
+  output_raster_index.assign(std::begin(spiral_to_raster), std::end(spiral_to_raster));
+
+  std::vector<size_t> missing;
+  run_reported_search(N_Hexes, [&](auto & sink, auto /* stats */) {
+    for (size_t shard_idx = 0; shard_idx != n_shards; ++shard_idx) {
+      const auto result_path = dir / (shard_name(shard_idx) + ".result");
+      if (!std::filesystem::exists(result_path)) {
+        missing.push_back(shard_idx);
+        continue;
+      }
+      for (const auto & board : read_boards(result_path, "HEX"))
+        sink(board);
+    }
+  });
+
+  for (const size_t shard_idx : missing)
+    std::cerr << "Shard " << shard_idx << " has no result yet\n";
+  return missing.empty();
+}
+
+int run_shard_command(const std::string & command, const std::string & dir)
 {
-  if (argc == 2) {
-    std::string strategy{argv[1]};
-    for (const auto & strat : strategies) {
-      if (strategy == strat.arg) {
-        strat.solve();
+  if (options.worker_id.empty())
+    options.worker_id = default_worker_id();
+
+  try {
+    if (command == "init")
+      init_shards(dir);
+    else if (command == "work")
+      run_shard_worker(dir);
+    else if (command == "collect")
+      return collect_shards(dir) ? 0 : 1;
+  } catch (const std::exception & e) {
+    std::cerr << "shard " << command << ": " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+/*
+  Run one strategy with the current options, as "solve-hex STRATEGY"
+  does, returning the exit status.
+*/
+int run_strategy(const StrategyOption & strat)
+{
+  if (options.count_only || options.exists_only || options.n_solutions_wanted != 0)
+    n_quiet_repeats = 0;
+  output_raster_index = strat.raster_index();
+  if (!checkpoint_path.empty()) {
+    if (!strat.checkpoints) {
+      std::cerr << "\"" << strat.arg << "\" does not support checkpoints\n";
+      return 1;
+    }
+    checkpoint_strategy = strat.arg;
+    last_checkpoint_time = std::chrono::steady_clock::now();
+    if (options.resume) {
+      bool finished = false;
+      if (!load_checkpoint(finished))
+        return 1;
+      if (finished) {
+        std::cerr << "Search in " << checkpoint_path << " already finished\n";
         return 0;
       }
+      n_attempts_bail_offset = n_attempts;
     }
   }
 
-  std::cerr << "Bad strategy label: allowed values:\n";
+  search_stopped_early = false;
+  try {
+    strat.check_options();
+    strat.solve();
+    if (!checkpoint_path.empty() && !search_stopped_early)
+      save_checkpoint(VecUInt8{}, n_attempts, CheckpointState::Finished);
+  } catch (const SearchBailed &) {
+  } catch (const std::exception & e) {
+    std::cerr << strat.arg << ": " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+/*
+  "solve-hex batch FILE" runs each job in FILE in turn in this one
+  process: a job is a line "STRATEGY [OPTIONS]", and blank lines and
+  lines starting with "#" are skipped.  Options given after FILE apply
+  to every job, before the job's own options.  Jobs do not make the
+  untimed repeat searches, and geometries and solve plans built for one
+  job are reused by later ones.  Jobs run one after another, not
+  concurrently: the strategies share process-wide state (attempt
+  counters, output cell order, checkpoints), and the parallel ones
+  already use every core.  The output of each job follows a "JOB:"
+  line, and the exit status is non-zero if any job failed.
+*/
+int run_batch(const std::string & path, int argc, char ** argv)
+{
+  std::ifstream in{path};
+  if (!in) {
+    std::cerr << "Could not read " << path << "\n";
+    return 1;
+  }
+
+  const std::vector<std::string> common_args(argv + 3, argv + argc);
+  int status = 0;
+  size_t job_idx = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream words{line};
+    std::vector<std::string> job_args{"solve-hex"};
+    for (std::string word; words >> word; )
+      job_args.push_back(word);
+    if (job_args.size() == 1 || job_args[1][0] == '#')
+      continue;
+
+    std::cout << "JOB: " << job_idx++ << ": " << line << "\n";
+
+    options = CommandLineOptions{};
+    checkpoint_path.clear();
+    checkpoint_period_seconds = 60.0;
+    resume_board.clear();
+    skip_solution.clear();
+    n_attempts = 0;
+    n_attempts_bail_offset = 0;
+    n_quiet_repeats = 0;
+
+    job_args.insert(job_args.begin() + 2, common_args.begin(), common_args.end());
+    std::vector<char *> job_argv;
+    for (auto & arg : job_args)
+      job_argv.push_back(&arg[0]);
+
+    const auto * strat = find_strategy(job_args[1]);
+    if (strat == nullptr) {
+      std::cerr << "Unknown strategy \"" << job_args[1] << "\"\n";
+      status = 1;
+    }
+    else if (!parse_options(static_cast<int>(job_argv.size()), job_argv.data(), 2)
+             || run_strategy(*strat) != 0)
+      status = 1;
+    std::cout.flush();
+  }
+  return status;
+}
+
+int main(int argc, char ** argv)
+{
+  if (argc >= 3 && std::string{argv[1]} == "bench") {
+    int arg_idx = 2;
+    std::vector<const StrategyOption *> to_bench;
+    for (; arg_idx < argc && std::string{argv[arg_idx]}.rfind("--", 0) != 0; ++arg_idx)
+      to_bench.push_back(find_strategy(argv[arg_idx]));
+
+    const bool all_found = std::none_of(
+      to_bench.begin(), to_bench.end(),
+      [](const StrategyOption * strat) { return strat == nullptr; });
+    if (!to_bench.empty() && all_found && parse_options(argc, argv, arg_idx)) {
+      std::vector<BenchmarkResult> results;
+      try {
+        for (const auto * strat : to_bench) {
+          strat->check_options();
+          results.push_back(run_benchmark(*strat));
+        }
+      } catch (const std::exception & e) {
+        std::cerr << "bench: " << e.what() << "\n";
+        return 1;
+      }
+      print_benchmark_results(results);
+      return 0;
+    }
+  }
+  else if (argc >= 2 && std::string{argv[1]} == "regress") {
+    if (parse_options(argc, argv, 2)) {
+      try {
+        return run_regression_suite();
+      } catch (const std::exception & e) {
+        std::cerr << "regress: " << e.what() << "\n";
+        return 1;
+      }
+    }
+  }
+  else if (argc == 3 && std::string{argv[1]} == "decode") {
+    return decode_binary_solutions(argv[2]) ? 0 : 1;
+  }
+  else if (argc >= 4 && std::string{argv[1]} == "shard") {
+    const std::string command{argv[2]};
+    const bool known_command = (command == "init" || command == "work"
+                                || command == "collect");
+    if (known_command && parse_options(argc, argv, 4))
+      return run_shard_command(command, argv[3]);
+  }
+  else if (argc >= 3 && std::string{argv[1]} == "batch") {
+    if (parse_options(argc, argv, 3))
+      return run_batch(argv[2], argc, argv);
+  }
+  else if (argc >= 2 && parse_options(argc, argv, 2)) {
+    if (const auto * strat = find_strategy(argv[1]))
+      return run_strategy(*strat);
+  }
+
+  std::cerr << "Usage: solve-hex STRATEGY [OPTIONS]\n";
+  std::cerr << "   or: solve-hex bench STRATEGY... [OPTIONS]\n";
+  std::cerr << "   or: solve-hex shard init|work|collect DIR [OPTIONS]\n";
+  std::cerr << "   or: solve-hex decode FILE\n";
+  std::cerr << "   or: solve-hex batch FILE [OPTIONS]\n";
+  std::cerr << "   or: solve-hex regress [OPTIONS]\n";
+  std::cerr << "\nOptions:\n";
+  for (const auto & opt : option_help) {
+    std::cerr << "\n" << opt.arg << opt.summary << "\n";
+  }
+
+  std::cerr << "\nStrategies:\n";
   for (const auto & strat : strategies) {
     std::cerr << "\n" << strat.arg << strat.summary << "\n";
   }